@@ -0,0 +1,791 @@
+//
+// Throughput benchmark for ParticleSystem::update. Sweeps particle counts and force kernels and
+// prints one row per (kernel, count) as CSV or JSON, so runs from different builds can be diffed.
+//
+// GPU kernels are timed with GL_TIME_ELAPSED queries around each step, CPU kernels with the wall
+// clock. Software rasterizers (llvmpipe) report near-zero timer query results, so GPU rows fall back
+// to the wall clock when the queries cover less than 1% of it; the clock column says which was used.
+// Interaction and FLOP rates count the N * (N - 1) pairs of a direct sum at 20 flops each; for the
+// symmetric kernel (one evaluation per pair) and the approximate solvers that makes them
+// direct-sum-equivalent rates.
+//
+// --validate also compares the accelerations of every kernel against a direct sum in double
+// precision, on the initial state and on a clustered set of Plummer spheres with the same particle
+// count, and adds max/rms relative error columns for both (-1 where not measured). GPU kernels are
+// checked through one extra Euler step from each state, the clustered one seeded through a restart
+// snapshot; gpu-tree also reports how many tree walks overflowed their stack over the whole run.
+// --max-error E makes the run exit non-zero when any measured max error (initial or clustered)
+// is above E or a tree walk overflowed its stack, which is how the ctest solver checks use it.
+// --accumulation picks how the direct sums add up their fp32 pair terms (see Accumulation in
+// include/force_solver.h), so running it with each mode gives that mode's error and speed.
+// Every row also records its integrator and the block timestep levels it ran with (the GPU steps
+// have none, so they report 0 whatever --block-levels says).
+//
+// CPU rows also report the task scheduler's mean worker utilization and steals per step over
+// the measured steps; --worker-stats additionally prints every worker's numbers to stderr.
+//
+// --readback N queues an async readback (ParticleSystemSettings::readbackInterval) every N steps
+// of the GPU kernels and polls for it every step, adding its mean latency (ms and polls, i.e.
+// steps), the number of requests that had to stall, and for comparison the time of one blocking
+// readState() straight after a step.
+//
+// --primitives benchmarks the GPU scan, compaction and radix sort (include/gpu_primitives.h)
+// instead, over the same counts: every result is checked against a CPU reference and the table
+// gets elements per second and a correct flag; any mismatch makes the run exit non-zero.
+//
+// run from the build directory (shader paths are relative to it):
+//   ./nbody_bench [--counts 1024,4096,16384] [--kernels gpu-direct,gpu-tiled,gpu-tree,cpu-direct,cpu-symmetric,cpu-tree,cpu-pm,cpu-p3m,cpu-fmm]
+//                 [--min-time SECONDS] [--warmup STEPS] [--mesh-size N] [--fmm-order P] [--fmm-leaf N]
+//                 [--sort-interval N] [--integrator euler|leapfrog|yoshida4|hermite4] [--block-levels N]
+//                 [--accumulation float|kahan|double] [--readback N] [--validate [--max-error E]]
+//                 [--worker-stats] [--primitives] [--format csv|json] [--output FILE]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <shader.h>
+#include <compute_shader.h>
+#include <gpu_primitives.h>
+#include <parallel.h>
+#include <particle_system.h>
+#include <physics.h>
+#include <snapshot.h>
+#include <task_scheduler.h>
+#ifdef HAVE_EGL
+#include <headless_context.h>
+#endif
+
+// conventional cost of one softened gravitational interaction
+const double FLOPS_PER_INTERACTION = 20.0;
+const float BENCH_TIMESTEP = 1.0f / 60.0f;
+
+struct BenchKernel {
+    const char* name;
+    bool gpu;
+    SimulationBackend backend;
+    ForceSolverType solver;
+    GpuKernel gpuKernel;
+};
+
+const std::vector<BenchKernel> BENCH_KERNELS = {
+    {"gpu-direct", true, SimulationBackend::GPU, ForceSolverType::DIRECT_SUM, GpuKernel::DIRECT_SUM},
+    {"gpu-tiled", true, SimulationBackend::GPU, ForceSolverType::DIRECT_SUM, GpuKernel::TILED},
+    {"gpu-tree", true, SimulationBackend::GPU, ForceSolverType::BARNES_HUT, GpuKernel::TREE},
+    {"cpu-direct", false, SimulationBackend::CPU, ForceSolverType::DIRECT_SUM, GpuKernel::DIRECT_SUM},
+    {"cpu-symmetric", false, SimulationBackend::CPU, ForceSolverType::DIRECT_SUM_SYMMETRIC, GpuKernel::DIRECT_SUM},
+    {"cpu-tree", false, SimulationBackend::CPU, ForceSolverType::BARNES_HUT, GpuKernel::DIRECT_SUM},
+    {"cpu-pm", false, SimulationBackend::CPU, ForceSolverType::PARTICLE_MESH, GpuKernel::DIRECT_SUM},
+    {"cpu-p3m", false, SimulationBackend::CPU, ForceSolverType::P3M, GpuKernel::DIRECT_SUM},
+    {"cpu-fmm", false, SimulationBackend::CPU, ForceSolverType::FMM, GpuKernel::DIRECT_SUM},
+};
+
+struct BenchOptions {
+    std::vector<int> counts = {1024, 4096, 16384};
+    std::vector<std::string> kernels = {"gpu-direct", "gpu-tiled", "gpu-tree", "cpu-direct", "cpu-symmetric", "cpu-tree", "cpu-pm", "cpu-p3m", "cpu-fmm"};
+    // each measurement runs steps until at least this much time was measured
+    double minTime = 1.0;
+    int warmupSteps = 2;
+    int meshSize = 64;
+    int fmmOrder = 4;
+    int fmmLeafSize = 32;
+    // Morton reorder interval passed to ParticleSystemSettings::sortInterval, 0 disables
+    int sortInterval = 0;
+    // ParticleSystemSettings::maxTimestepLevel, 0 runs shared timesteps
+    int blockLevels = 0;
+    // ParticleSystemSettings::readbackInterval for the GPU kernels, 0 disables
+    int readbackInterval = 0;
+    IntegratorType integrator = IntegratorType::EULER;
+    Accumulation accumulation = Accumulation::FLOAT;
+    bool validate = false;
+    // with validate: fail the run when a max error is above this, negative never fails
+    double maxError = -1.0;
+    bool workerStats = false;
+    bool primitives = false;
+    bool json = false;
+    std::string outputPath;
+};
+
+struct BenchResult {
+    std::string kernel;
+    int particles;
+    int steps;
+    double seconds;
+    const char* clock;
+    const char* accumulation = "float";
+    const char* integrator = "euler";
+    // block timestep levels the run actually used, 0 for shared steps and on the GPU
+    int blockLevels = 0;
+    float maxError = -1.0f;
+    float rmsError = -1.0f;
+    float clusteredMaxError = -1.0f;
+    float clusteredRmsError = -1.0f;
+    // GPU tree walks that ran out of stack, -1 for the other kernels
+    int64_t treeStackOverflows = -1;
+    // amortised cost of the Morton reorders during the measured steps
+    double sortMillisecondsPerStep = 0.0;
+    // block timesteps: force evaluations / (N * substeps), 1 with shared timesteps
+    double evaluationFraction = 1.0;
+    // TaskScheduler over the measured steps, -1 for GPU rows
+    double workerUtilization = -1.0;
+    double stealsPerStep = -1.0;
+    // --readback, -1 when not measured
+    double readbackLatencyMilliseconds = -1.0;
+    double readbackLatencySteps = -1.0;
+    long long readbackStalls = -1;
+    double syncReadbackMilliseconds = -1.0;
+
+    double stepsPerSecond() const { return steps / seconds; }
+    double interactionsPerSecond() const { return (double)particles * (particles - 1) * steps / seconds; }
+    double gflops() const { return interactionsPerSecond() * FLOPS_PER_INTERACTION * 1e-9; }
+};
+
+struct PrimitiveResult {
+    std::string primitive;
+    int elements;
+    int repeats;
+    double seconds;
+    bool correct;
+
+    double elementsPerSecond() const { return (double)elements * repeats / seconds; }
+};
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+BenchOptions parseArguments(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "missing value for " << argv[i] << std::endl;
+                std::exit(-1);
+            }
+            return argv[++i];
+        };
+        if (std::strcmp(argv[i], "--counts") == 0) {
+            options.counts.clear();
+            for (const std::string& count : splitList(value())) {
+                options.counts.push_back(std::stoi(count));
+            }
+        } else if (std::strcmp(argv[i], "--kernels") == 0) {
+            options.kernels = splitList(value());
+        } else if (std::strcmp(argv[i], "--min-time") == 0) {
+            options.minTime = std::stod(value());
+        } else if (std::strcmp(argv[i], "--warmup") == 0) {
+            options.warmupSteps = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--mesh-size") == 0) {
+            options.meshSize = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--fmm-order") == 0) {
+            options.fmmOrder = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--fmm-leaf") == 0) {
+            options.fmmLeafSize = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--sort-interval") == 0) {
+            options.sortInterval = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--integrator") == 0) {
+            const char* name = value();
+            if (std::strcmp(name, "leapfrog") == 0) {
+                options.integrator = IntegratorType::LEAPFROG;
+            } else if (std::strcmp(name, "yoshida4") == 0) {
+                options.integrator = IntegratorType::YOSHIDA4;
+            } else if (std::strcmp(name, "hermite4") == 0) {
+                options.integrator = IntegratorType::HERMITE4;
+            } else if (std::strcmp(name, "euler") == 0) {
+                options.integrator = IntegratorType::EULER;
+            } else {
+                std::cerr << "unknown integrator " << name << ", expected euler, leapfrog, yoshida4 or hermite4" << std::endl;
+                std::exit(-1);
+            }
+        } else if (std::strcmp(argv[i], "--block-levels") == 0) {
+            options.blockLevels = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--accumulation") == 0) {
+            const char* name = value();
+            if (std::strcmp(name, "kahan") == 0) {
+                options.accumulation = Accumulation::KAHAN;
+            } else if (std::strcmp(name, "double") == 0) {
+                options.accumulation = Accumulation::DOUBLE;
+            } else if (std::strcmp(name, "float") == 0) {
+                options.accumulation = Accumulation::FLOAT;
+            } else {
+                std::cerr << "unknown accumulation " << name << ", expected float, kahan or double" << std::endl;
+                std::exit(-1);
+            }
+        } else if (std::strcmp(argv[i], "--readback") == 0) {
+            options.readbackInterval = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--validate") == 0) {
+            options.validate = true;
+        } else if (std::strcmp(argv[i], "--max-error") == 0) {
+            options.maxError = std::stod(value());
+        } else if (std::strcmp(argv[i], "--worker-stats") == 0) {
+            options.workerStats = true;
+        } else if (std::strcmp(argv[i], "--primitives") == 0) {
+            options.primitives = true;
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            const char* format = value();
+            if (std::strcmp(format, "json") == 0) {
+                options.json = true;
+            } else if (std::strcmp(format, "csv") == 0) {
+                options.json = false;
+            } else {
+                std::cerr << "unknown format " << format << ", expected csv or json" << std::endl;
+                std::exit(-1);
+            }
+        } else if (std::strcmp(argv[i], "--output") == 0) {
+            options.outputPath = value();
+        } else {
+            std::cerr << "unknown argument " << argv[i] << "\n"
+                      << "usage: " << argv[0] << " [--counts N,N,...] [--kernels NAME,NAME,...] [--min-time SECONDS]\n"
+                      << "       [--warmup STEPS] [--mesh-size N] [--fmm-order P] [--fmm-leaf N] [--sort-interval N]\n"
+                      << "       [--integrator euler|leapfrog|yoshida4|hermite4] [--block-levels N]\n"
+                      << "       [--accumulation float|kahan|double] [--readback N] [--validate [--max-error E]]\n"
+                      << "       [--worker-stats] [--primitives] [--format csv|json] [--output FILE]" << std::endl;
+            std::exit(-1);
+        }
+    }
+    return options;
+}
+
+const BenchKernel* findKernel(const std::string& name) {
+    for (const BenchKernel& kernel : BENCH_KERNELS) {
+        if (name == kernel.name) return &kernel;
+    }
+    return nullptr;
+}
+
+ParticleSystemSettings benchSettings(const BenchKernel& kernel, int particles, const BenchOptions& options) {
+    ParticleSystemSettings settings;
+    settings.numParticles = particles;
+    settings.backend = kernel.backend;
+    settings.solver = kernel.solver;
+    if (kernel.gpuKernel == GpuKernel::TILED) {
+        settings.directSumKernel = GpuKernel::TILED;
+    }
+    settings.meshSize = options.meshSize;
+    settings.fmmOrder = options.fmmOrder;
+    settings.fmmLeafSize = options.fmmLeafSize;
+    settings.sortInterval = options.sortInterval;
+    settings.maxTimestepLevel = options.blockLevels;
+    settings.integrator = options.integrator;
+    settings.accumulation = options.accumulation;
+    if (kernel.gpu) {
+        settings.readbackInterval = options.readbackInterval;
+    }
+    return settings;
+}
+
+const char* integratorName(IntegratorType integrator) {
+    switch (integrator) {
+        case IntegratorType::LEAPFROG: return "leapfrog";
+        case IntegratorType::YOSHIDA4: return "yoshida4";
+        case IntegratorType::HERMITE4: return "hermite4";
+        default: return "euler";
+    }
+}
+
+const char* accumulationName(Accumulation accumulation) {
+    switch (accumulation) {
+        case Accumulation::KAHAN: return "kahan";
+        case Accumulation::DOUBLE: return "double";
+        default: return "float";
+    }
+}
+
+// a few Plummer spheres of different sizes, much more concentrated than the initial disk
+std::vector<glm::vec4> clusteredPositions(int particles) {
+    std::default_random_engine generator(4711);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_real_distribution<float> massDistribution(50000.0f, 100000.0f);
+    const int clusters = 5;
+    std::vector<glm::vec4> positions;
+    positions.reserve(particles);
+    for (int i = 0; i < particles; i++) {
+        int cluster = i % clusters;
+        glm::vec3 center(std::cos(cluster * 1.3f), std::sin(cluster * 1.3f), 0.2f * cluster - 0.4f);
+        float scale = 0.02f + 0.05f * cluster;
+        // inverse CDF of the Plummer mass profile, radii truncated at 10 scale lengths
+        float m = std::min(unit(generator), 0.999f);
+        float radius = scale / std::sqrt(std::pow(m, -2.0f / 3.0f) - 1.0f);
+        float cosTheta = 2.0f * unit(generator) - 1.0f;
+        float phi = 2.0f * (float)M_PI * unit(generator);
+        float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        glm::vec3 direction(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+        positions.emplace_back(center + direction * radius, massDistribution(generator));
+    }
+    return positions;
+}
+
+// the same pair terms as the direct sums, entirely in double
+std::vector<glm::vec3> exactAccelerations(const std::vector<glm::vec4>& positions) {
+    std::vector<glm::vec3> accelerations(positions.size());
+    parallelFor(0, positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            glm::dvec3 pos(positions[i]);
+            glm::dvec3 acc(0.0);
+            for (size_t j = 0; j < positions.size(); j++) {
+                glm::dvec3 dir = glm::dvec3(positions[j]) - pos;
+                double distSqr = glm::dot(dir, dir);
+                if (distSqr == 0.0) continue;
+                acc += dir * ((double)positions[j].w / (std::sqrt(distSqr) * (distSqr + (double)PhysicsConstants::SOFTENING)));
+            }
+            accelerations[i] = glm::vec3(acc * (double)PhysicsConstants::G);
+        }
+    }, 16);
+    return accelerations;
+}
+
+void validate(BenchResult& result, const ParticleSystemSettings& settings, const std::vector<glm::vec4>& positions) {
+    std::vector<glm::vec3> reference = exactAccelerations(positions), approx;
+    createForceSolver(settings)->computeAccelerations(positions, approx);
+    result.maxError = maxRelativeError(reference, approx);
+    result.rmsError = rmsRelativeError(reference, approx);
+
+    std::vector<glm::vec4> clustered = clusteredPositions((int)positions.size());
+    reference = exactAccelerations(clustered);
+    createForceSolver(settings)->computeAccelerations(clustered, approx);
+    result.clusteredMaxError = maxRelativeError(reference, approx);
+    result.clusteredRmsError = rmsRelativeError(reference, approx);
+}
+
+BenchResult runCpu(const BenchKernel& kernel, int particles, const BenchOptions& options) {
+    ParticleSystemSettings settings = benchSettings(kernel, particles, options);
+    ParticleSystem particleSystem(nullptr, nullptr, settings);
+    std::vector<glm::vec4> initialPositions = particleSystem.readState().positions;
+
+    for (int step = 0; step < options.warmupSteps; step++) {
+        particleSystem.update(BENCH_TIMESTEP);
+    }
+
+    BenchResult result{kernel.name, particles, 0, 0.0, "wall", accumulationName(options.accumulation), integratorName(settings.integrator)};
+    result.blockLevels = particleSystem.getSettings().maxTimestepLevel;
+    double sortSecondsBefore = particleSystem.getSortStats().totalSeconds;
+    TaskScheduler& scheduler = TaskScheduler::instance();
+    scheduler.resetStats();
+    auto start = std::chrono::steady_clock::now();
+    while (result.seconds < options.minTime) {
+        particleSystem.update(BENCH_TIMESTEP);
+        result.steps++;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::vector<WorkerStats> workers = scheduler.workerStats();
+    uint64_t steals = 0;
+    result.workerUtilization = 0.0;
+    for (size_t slot = 0; slot < workers.size(); slot++) {
+        steals += workers[slot].steals;
+        result.workerUtilization += workers[slot].utilization / workers.size();
+        if (options.workerStats) {
+            std::cerr << kernel.name << ' ' << particles << " worker " << slot << ": " << workers[slot].tasks
+                      << " tasks, " << workers[slot].steals << " steals, " << workers[slot].utilization * 100.0 << "% busy" << std::endl;
+        }
+    }
+    result.stealsPerStep = (double)steals / result.steps;
+    result.sortMillisecondsPerStep = (particleSystem.getSortStats().totalSeconds - sortSecondsBefore) * 1e3 / result.steps;
+    const BlockStepStats& blockStats = particleSystem.getBlockStepStats();
+    if (blockStats.particleSubsteps > 0) {
+        result.evaluationFraction = (double)blockStats.evaluations / blockStats.particleSubsteps;
+    }
+    if (options.validate) {
+        validate(result, settings, initialPositions);
+    }
+    return result;
+}
+
+// a fresh system takes one Euler step, whose force evaluation used the initial positions
+void validateGpu(BenchResult& result, const BenchKernel& kernel, ParticleSystemSettings settings, Shader& pipelineShaders) {
+    settings.integrator = IntegratorType::EULER;
+    settings.sortInterval = 0;
+    ComputeShader computeShader(gpuKernelPath(kernel.gpuKernel));
+    auto measure = [&](const ParticleSystemSettings& settings, float& maxError, float& rmsError) {
+        ParticleSystem particleSystem(&pipelineShaders, &computeShader, settings);
+        std::vector<glm::vec4> positions = particleSystem.readState().positions;
+        particleSystem.update(BENCH_TIMESTEP);
+        std::vector<glm::vec3> reference = exactAccelerations(positions);
+        const std::vector<glm::vec3>& approx = particleSystem.readAccelerations();
+        maxError = maxRelativeError(reference, approx);
+        rmsError = rmsRelativeError(reference, approx);
+        if (result.treeStackOverflows >= 0) result.treeStackOverflows += particleSystem.readTreeStackOverflows();
+    };
+    measure(settings, result.maxError, result.rmsError);
+
+    // a GPU system can only be seeded with a given state through a restart snapshot
+    ParticleState clustered;
+    clustered.positions = clusteredPositions(settings.numParticles);
+    clustered.velocities.assign(clustered.size(), glm::vec4(0.0f));
+    clustered.ids.resize(clustered.size());
+    std::iota(clustered.ids.begin(), clustered.ids.end(), 0u);
+    // in the temp directory, since the ctest checks run from the source tree
+    settings.restartPath = (std::filesystem::temp_directory_path() / "nbody_bench_clustered.nbody").string();
+    if (!writeSnapshot(settings.restartPath, clustered, 0, 0.0)) return;
+    measure(settings, result.clusteredMaxError, result.clusteredRmsError);
+    std::remove(settings.restartPath.c_str());
+}
+
+// the GL context must be current; the pipeline shaders are only needed so the system allocates
+// its buffers, nothing is drawn
+BenchResult runGpu(const BenchKernel& kernel, int particles, const BenchOptions& options, Shader& pipelineShaders) {
+    ParticleSystemSettings settings = benchSettings(kernel, particles, options);
+    // Hermite replaces the kernel's program with its own
+    GpuKernel gpuKernel = settings.integrator == IntegratorType::HERMITE4 ? GpuKernel::HERMITE : kernel.gpuKernel;
+    ComputeShader computeShader(gpuKernelPath(gpuKernel));
+    ParticleSystem particleSystem(&pipelineShaders, &computeShader, settings);
+
+    for (int step = 0; step < options.warmupSteps; step++) {
+        particleSystem.update(BENCH_TIMESTEP);
+    }
+    glFinish();
+
+    GLuint query;
+    glGenQueries(1, &query);
+    BenchResult result{kernel.name, particles, 0, 0.0, "gpu", accumulationName(options.accumulation), integratorName(settings.integrator)};
+    double sortSecondsBefore = particleSystem.getSortStats().totalSeconds;
+    double wallSeconds = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    while (wallSeconds < options.minTime) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        particleSystem.update(BENCH_TIMESTEP);
+        glEndQuery(GL_TIME_ELAPSED);
+        // the consumer side of --readback; the copy is not touched, only its arrival matters here
+        particleSystem.pollReadback();
+        // waits for the step to finish, which keeps at most one step in flight
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        result.steps++;
+        result.seconds += elapsed * 1e-9;
+        wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    glDeleteQueries(1, &query);
+    if (const ReadbackStats* readbackStats = particleSystem.getReadbackStats()) {
+        result.readbackLatencyMilliseconds = readbackStats->meanLatencySeconds() * 1e3;
+        result.readbackLatencySteps = readbackStats->meanLatencyPolls();
+        result.readbackStalls = (long long)readbackStats->stalls;
+
+        particleSystem.update(BENCH_TIMESTEP);
+        auto readStart = std::chrono::steady_clock::now();
+        particleSystem.readState();
+        result.syncReadbackMilliseconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count() * 1e3;
+    }
+    result.sortMillisecondsPerStep = (particleSystem.getSortStats().totalSeconds - sortSecondsBefore) * 1e3 / result.steps;
+    if (result.seconds < 0.01 * wallSeconds) {
+        result.seconds = wallSeconds;
+        result.clock = "wall";
+    }
+    if (kernel.gpuKernel == GpuKernel::TREE) {
+        result.treeStackOverflows = particleSystem.readTreeStackOverflows();
+    }
+    if (options.validate) {
+        validateGpu(result, kernel, settings, pipelineShaders);
+    }
+    return result;
+}
+
+#ifdef HAVE_EGL
+GLuint createBuffer(const std::vector<uint32_t>& data) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, data.size() * sizeof(uint32_t), data.data(), GL_DYNAMIC_COPY);
+    return buffer;
+}
+
+std::vector<uint32_t> readBuffer(GLuint buffer, size_t words) {
+    std::vector<uint32_t> data(words);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, words * sizeof(uint32_t), data.data());
+    return data;
+}
+
+// repeats operation until minTime has passed; operation restores its own input first, so that
+// part (a buffer copy) is included in the time
+template <typename Operation>
+PrimitiveResult timePrimitive(const char* name, int elements, double minTime, Operation operation) {
+    PrimitiveResult result{name, elements, 0, 0.0, true};
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    while (result.seconds < minTime) {
+        operation();
+        glFinish();
+        result.repeats++;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return result;
+}
+
+void copyBuffer(GLuint source, GLuint target, size_t words) {
+    glBindBuffer(GL_COPY_READ_BUFFER, source);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, words * sizeof(uint32_t));
+}
+
+// each primitive runs once on random input and is compared with the std:: equivalent (a stable
+// sort for the radix sort, so equal keys must keep their order), then timed
+void runPrimitives(int elements, const BenchOptions& options, std::vector<PrimitiveResult>& results) {
+    std::default_random_engine generator(97 + elements);
+    std::uniform_int_distribution<uint32_t> words;
+    size_t count = (size_t)elements;
+
+    std::vector<uint32_t> values(count), flags(count);
+    std::vector<uint32_t> keys32(count), keys64(2 * count);
+    for (size_t i = 0; i < count; i++) {
+        values[i] = words(generator) % 1000;
+        flags[i] = words(generator) % 3 == 0 ? 1 : 0;
+        // a narrow key range so the stability of the sort is exercised
+        keys32[i] = words(generator) % (uint32_t)(count / 4 + 1);
+        keys64[2 * i] = words(generator);
+        keys64[2 * i + 1] = words(generator) % 64;
+    }
+    std::vector<uint32_t> indices(count);
+    for (size_t i = 0; i < count; i++) indices[i] = (uint32_t)i;
+
+    GpuScan scan;
+    GpuCompaction compaction;
+    GpuRadixSort sort;
+    GLuint valueBuffer = createBuffer(values);
+    GLuint flagBuffer = createBuffer(flags);
+    GLuint outputBuffer = createBuffer(std::vector<uint32_t>(2 * count));
+    GLuint keySource = createBuffer(keys64);
+    GLuint keyBuffer = createBuffer(keys64);
+    GLuint indexSource = createBuffer(indices);
+    GLuint indexBuffer = createBuffer(indices);
+
+    // scan
+    std::vector<uint32_t> expected(count);
+    std::exclusive_scan(values.begin(), values.end(), expected.begin(), 0u);
+    scan.exclusiveScan(valueBuffer, outputBuffer, elements);
+    bool correct = readBuffer(outputBuffer, count) == expected;
+    results.push_back(timePrimitive("gpu-scan", elements, options.minTime, [&]() {
+        scan.exclusiveScan(valueBuffer, outputBuffer, elements);
+    }));
+    results.back().correct = correct;
+
+    // compaction
+    expected.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (flags[i] != 0) expected.push_back(values[i]);
+    }
+    uint32_t kept = compaction.compact(flagBuffer, valueBuffer, outputBuffer, elements);
+    correct = kept == expected.size() && readBuffer(outputBuffer, kept) == expected;
+    results.push_back(timePrimitive("gpu-compact", elements, options.minTime, [&]() {
+        compaction.compact(flagBuffer, valueBuffer, outputBuffer, elements);
+    }));
+    results.back().correct = correct;
+
+    // key-value sorts, 32 and 64 bit
+    for (int keyBits : {32, 64}) {
+        size_t keyWords = keyBits / 32;
+        const std::vector<uint32_t>& keys = keyBits == 32 ? keys32 : keys64;
+        std::vector<uint32_t> order(indices);
+        auto keyOf = [&](uint32_t i) {
+            return keyWords == 1 ? (uint64_t)keys[i] : (uint64_t)keys[2 * i + 1] << 32 | keys[2 * i];
+        };
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keyOf(a) < keyOf(b); });
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, keySource);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * keyWords * sizeof(uint32_t), keys.data());
+        auto run = [&]() {
+            copyBuffer(keySource, keyBuffer, count * keyWords);
+            copyBuffer(indexSource, indexBuffer, count);
+            sort.sort(keyBuffer, indexBuffer, elements, keyBits);
+        };
+        run();
+        std::vector<uint32_t> sortedKeys = readBuffer(keyBuffer, count * keyWords);
+        correct = readBuffer(indexBuffer, count) == order;
+        for (size_t i = 0; correct && i < count; i++) {
+            uint64_t key = keyWords == 1 ? (uint64_t)sortedKeys[i] : (uint64_t)sortedKeys[2 * i + 1] << 32 | sortedKeys[2 * i];
+            correct = key == keyOf(order[i]);
+        }
+        results.push_back(timePrimitive(keyBits == 32 ? "gpu-sort32" : "gpu-sort64", elements, options.minTime, run));
+        results.back().correct = correct;
+    }
+
+    GLuint buffers[] = {valueBuffer, flagBuffer, outputBuffer, keySource, keyBuffer, indexSource, indexBuffer};
+    glDeleteBuffers(7, buffers);
+}
+#endif
+
+void writePrimitivesCsv(std::ostream& out, const std::vector<PrimitiveResult>& results) {
+    out << "primitive,elements,repeats,seconds,elements_per_second,correct\n";
+    for (const PrimitiveResult& result : results) {
+        out << result.primitive << ',' << result.elements << ',' << result.repeats << ',' << result.seconds << ','
+            << result.elementsPerSecond() << ',' << (result.correct ? 1 : 0) << '\n';
+    }
+}
+
+void writePrimitivesJson(std::ostream& out, const std::vector<PrimitiveResult>& results, const std::string& renderer) {
+    out << "{\n  \"renderer\": \"" << renderer << "\",\n  \"primitives\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const PrimitiveResult& result = results[i];
+        out << "    {\"primitive\": \"" << result.primitive << "\", \"elements\": " << result.elements
+            << ", \"repeats\": " << result.repeats << ", \"seconds\": " << result.seconds
+            << ", \"elements_per_second\": " << result.elementsPerSecond()
+            << ", \"correct\": " << (result.correct ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+void writeCsv(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "kernel,particles,steps,seconds,clock,steps_per_second,interactions_per_second,gflops,sort_ms_per_step,evaluation_fraction,worker_utilization,steals_per_step,readback_latency_ms,readback_latency_steps,readback_stalls,sync_readback_ms,max_error,rms_error,clustered_max_error,clustered_rms_error,accumulation,integrator,block_levels,tree_stack_overflows\n";
+    for (const BenchResult& result : results) {
+        out << result.kernel << ',' << result.particles << ',' << result.steps << ',' << result.seconds << ',' << result.clock << ','
+            << result.stepsPerSecond() << ',' << result.interactionsPerSecond() << ',' << result.gflops() << ',' << result.sortMillisecondsPerStep << ',' << result.evaluationFraction << ','
+            << result.workerUtilization << ',' << result.stealsPerStep << ','
+            << result.readbackLatencyMilliseconds << ',' << result.readbackLatencySteps << ','
+            << result.readbackStalls << ',' << result.syncReadbackMilliseconds << ','
+            << result.maxError << ',' << result.rmsError << ','
+            << result.clusteredMaxError << ',' << result.clusteredRmsError << ',' << result.accumulation << ','
+            << result.integrator << ',' << result.blockLevels << ','
+            << result.treeStackOverflows << '\n';
+    }
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchResult>& results, const std::string& renderer) {
+    out << "{\n  \"renderer\": \"" << renderer << "\",\n  \"threads\": " << workerCount() << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        out << "    {\"kernel\": \"" << result.kernel << "\", \"particles\": " << result.particles
+            << ", \"steps\": " << result.steps << ", \"seconds\": " << result.seconds
+            << ", \"clock\": \"" << result.clock << "\""
+            << ", \"steps_per_second\": " << result.stepsPerSecond()
+            << ", \"interactions_per_second\": " << result.interactionsPerSecond()
+            << ", \"gflops\": " << result.gflops()
+            << ", \"sort_ms_per_step\": " << result.sortMillisecondsPerStep
+            << ", \"evaluation_fraction\": " << result.evaluationFraction
+            << ", \"worker_utilization\": " << result.workerUtilization
+            << ", \"steals_per_step\": " << result.stealsPerStep
+            << ", \"readback_latency_ms\": " << result.readbackLatencyMilliseconds
+            << ", \"readback_latency_steps\": " << result.readbackLatencySteps
+            << ", \"readback_stalls\": " << result.readbackStalls
+            << ", \"sync_readback_ms\": " << result.syncReadbackMilliseconds
+            << ", \"max_error\": " << result.maxError << ", \"rms_error\": " << result.rmsError
+            << ", \"clustered_max_error\": " << result.clusteredMaxError
+            << ", \"clustered_rms_error\": " << result.clusteredRmsError
+            << ", \"accumulation\": \"" << result.accumulation << "\""
+            << ", \"integrator\": \"" << result.integrator << "\", \"block_levels\": " << result.blockLevels
+            << ", \"tree_stack_overflows\": " << result.treeStackOverflows << "}" << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = parseArguments(argc, argv);
+
+    std::vector<const BenchKernel*> kernels;
+    bool needsGpu = false;
+    for (const std::string& name : options.kernels) {
+        const BenchKernel* kernel = findKernel(name);
+        if (kernel == nullptr) {
+            std::cerr << "unknown kernel " << name << std::endl;
+            return -1;
+        }
+        kernels.push_back(kernel);
+        needsGpu = needsGpu || kernel->gpu;
+    }
+
+    std::vector<BenchResult> results;
+    std::vector<PrimitiveResult> primitiveResults;
+    std::string renderer = "none";
+    try {
+#ifdef HAVE_EGL
+        std::unique_ptr<HeadlessContext> context;
+        std::unique_ptr<Shader> pipelineShaders;
+        if (options.primitives) {
+            context = std::make_unique<HeadlessContext>();
+            renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            for (int elements : options.counts) {
+                std::cerr << "primitives n=" << elements << std::endl;
+                runPrimitives(elements, options, primitiveResults);
+            }
+            kernels.clear();
+        } else if (needsGpu) {
+            context = std::make_unique<HeadlessContext>();
+            pipelineShaders = std::make_unique<Shader>("../shaders/vertex.glsl", "../shaders/fragment.glsl");
+            renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        }
+#else
+        if (options.primitives) {
+            std::cerr << "--primitives needs a build with headless (EGL) support" << std::endl;
+            return -1;
+        }
+#endif
+        for (const BenchKernel* kernel : kernels) {
+            for (int particles : options.counts) {
+                std::cerr << kernel->name << " n=" << particles << std::endl;
+                if (!kernel->gpu) {
+                    results.push_back(runCpu(*kernel, particles, options));
+                    continue;
+                }
+#ifdef HAVE_EGL
+                results.push_back(runGpu(*kernel, particles, options, *pipelineShaders));
+#else
+                std::cerr << "skipping " << kernel->name << ", this build has no headless (EGL) support" << std::endl;
+                break;
+#endif
+            }
+        }
+    } catch (std::runtime_error& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return -1;
+    }
+
+    std::ofstream file;
+    if (!options.outputPath.empty()) {
+        file.open(options.outputPath);
+        if (!file) {
+            std::cerr << "ERROR::BENCH::COULD_NOT_OPEN " << options.outputPath << std::endl;
+            return -1;
+        }
+    }
+    std::ostream& out = options.outputPath.empty() ? std::cout : file;
+    if (options.primitives) {
+        if (options.json) {
+            writePrimitivesJson(out, primitiveResults, renderer);
+        } else {
+            writePrimitivesCsv(out, primitiveResults);
+        }
+        for (const PrimitiveResult& result : primitiveResults) {
+            if (!result.correct) return 1;
+        }
+        return 0;
+    }
+    if (options.json) {
+        writeJson(out, results, renderer);
+    } else {
+        writeCsv(out, results);
+    }
+    if (options.validate && options.maxError >= 0.0) {
+        int failed = 0;
+        for (const BenchResult& result : results) {
+            if (result.maxError > options.maxError || result.clusteredMaxError > options.maxError) {
+                std::cerr << result.kernel << " n=" << result.particles << ": max error " << result.maxError
+                          << ", clustered " << result.clusteredMaxError << ", above " << options.maxError << std::endl;
+                failed++;
+            } else if (result.treeStackOverflows > 0) {
+                std::cerr << result.kernel << " n=" << result.particles << ": " << result.treeStackOverflows
+                          << " tree walks ran out of stack" << std::endl;
+                failed++;
+            }
+        }
+        if (failed > 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+//
+// Correctness check for the GPU path's async readbacks (ParticleSystemSettings::readbackInterval).
+// Steps a GPU system with Morton sorts in between, keeps a blocking readState() of every step a
+// copy was requested at, and compares every copy pollReadback() hands out against the one of the
+// step its tag names, bit for bit. Runs with a readback every step and every few steps, and polling
+// every step or only every few, which makes requests overtake each other and find the ring full.
+// Exits non-zero on any mismatch, which is how the ctest check uses it.
+//
+// needs a build with headless (EGL) support; run from bench/ or the build directory (shader
+// paths are relative):
+//   ./readback_check [--particles N] [--steps N]
+//
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <compute_shader.h>
+#include <headless_context.h>
+#include <particle_system.h>
+#include <shader.h>
+
+const float CHECK_TIMESTEP = 1.0f / 60.0f;
+
+struct CheckOptions {
+    int particles = 1024;
+    int steps = 60;
+};
+
+struct ReadbackCase {
+    int readbackInterval;
+    // pollReadback() is called after every pollInterval-th step only
+    int pollInterval;
+};
+
+const std::vector<ReadbackCase> READBACK_CASES = {{1, 1}, {3, 1}, {1, 4}, {2, 5}};
+
+CheckOptions parseArguments(int argc, char** argv) {
+    CheckOptions options;
+    for (int i = 1; i < argc; i++) {
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "missing value for " << argv[i] << std::endl;
+                std::exit(-1);
+            }
+            return argv[++i];
+        };
+        if (std::strcmp(argv[i], "--particles") == 0) {
+            options.particles = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--steps") == 0) {
+            options.steps = std::stoi(value());
+        } else {
+            std::cerr << "usage: readback_check [--particles N] [--steps N]" << std::endl;
+            std::exit(-1);
+        }
+    }
+    return options;
+}
+
+template <typename T>
+bool sameBits(const std::vector<T>& a, const std::vector<T>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+// the number of mismatched or missing copies
+int checkCase(const ReadbackCase& readbackCase, const CheckOptions& options, Shader& pipelineShaders, ComputeShader& computeShader) {
+    ParticleSystemSettings settings;
+    settings.numParticles = options.particles;
+    settings.backend = SimulationBackend::GPU;
+    settings.sortInterval = 4;
+    settings.readbackInterval = readbackCase.readbackInterval;
+    ParticleSystem particleSystem(&pipelineShaders, &computeShader, settings);
+
+    std::string name = "interval " + std::to_string(readbackCase.readbackInterval) + ", polled every " + std::to_string(readbackCase.pollInterval);
+    int failures = 0;
+    uint64_t delivered = 0;
+    uint64_t lastTag = 0;
+    // blocking reads of the requested steps whose copy has not been handed out yet
+    std::map<uint64_t, ParticleState> expected;
+    for (int step = 1; step <= options.steps; step++) {
+        particleSystem.update(CHECK_TIMESTEP);
+        if (step % readbackCase.readbackInterval == 0) {
+            expected[particleSystem.getStepCount()] = particleSystem.readState();
+        }
+        if (step % readbackCase.pollInterval != 0) continue;
+
+        uint64_t tag = 0;
+        const ParticleState* copy = particleSystem.pollReadback(&tag);
+        if (copy == nullptr) continue;
+        delivered++;
+        auto reference = expected.find(tag);
+        if (tag <= lastTag || reference == expected.end()) {
+            std::cerr << name << ": step " << step << " got a copy tagged " << tag << ", which was never requested or came back before" << std::endl;
+            failures++;
+            continue;
+        }
+        if (!sameBits(copy->positions, reference->second.positions) || !sameBits(copy->velocities, reference->second.velocities)
+                || !sameBits(copy->ids, reference->second.ids)) {
+            std::cerr << name << ": the copy of step " << tag << " differs from readState() of that step" << std::endl;
+            failures++;
+        }
+        lastTag = tag;
+        // older copies were overtaken and will not come back
+        expected.erase(expected.begin(), std::next(reference));
+    }
+
+    const ReadbackStats* stats = particleSystem.getReadbackStats();
+    std::cout << name << ": " << stats->requests << " requests, " << delivered << " copies checked, "
+              << stats->stalls << " stalls" << std::endl;
+    if (delivered == 0) {
+        std::cerr << name << ": no copy ever arrived" << std::endl;
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    CheckOptions options = parseArguments(argc, argv);
+    int failures = 0;
+    try {
+        HeadlessContext context;
+        Shader pipelineShaders("../shaders/vertex.glsl", "../shaders/fragment.glsl");
+        ComputeShader computeShader(gpuKernelPath(GpuKernel::DIRECT_SUM));
+        std::cout << "renderer: " << reinterpret_cast<const char*>(glGetString(GL_RENDERER)) << std::endl;
+        for (const ReadbackCase& readbackCase : READBACK_CASES) {
+            failures += checkCase(readbackCase, options, pipelineShaders, computeShader);
+        }
+    } catch (std::runtime_error& e) {
+        std::cerr << "Readback check failed: " << e.what() << std::endl;
+        return -1;
+    }
+    if (failures > 0) {
+        std::cerr << failures << " readback checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
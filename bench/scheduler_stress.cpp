@@ -0,0 +1,181 @@
+//
+// Stress check for TaskScheduler. Runs rounds of the patterns the solvers and the block
+// timestepper lean on, on a dedicated pool of 8 slots regardless of the core count: nested
+// parallelFor, dependency chains that must run in order, a fan-in over finished and unfinished
+// dependencies, and tasks that submit children and wait for them. Every result is checked, and
+// the run fails unless some task was stolen. Exits non-zero on any failure, which is how the
+// ctest check uses it; build it with -fsanitize=thread to have TSAN watch the same interleavings.
+//
+// run from anywhere:
+//   ./scheduler_stress [--rounds N] [--workers N]
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <task_scheduler.h>
+
+struct StressOptions {
+    int rounds = 200;
+    unsigned int workers = 8;
+};
+
+StressOptions parseArguments(int argc, char** argv) {
+    StressOptions options;
+    for (int i = 1; i < argc; i++) {
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "missing value for " << argv[i] << std::endl;
+                std::exit(-1);
+            }
+            return argv[++i];
+        };
+        if (std::strcmp(argv[i], "--rounds") == 0) {
+            options.rounds = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--workers") == 0) {
+            options.workers = (unsigned int)std::stoi(value());
+        } else {
+            std::cerr << "usage: scheduler_stress [--rounds N] [--workers N]" << std::endl;
+            std::exit(-1);
+        }
+    }
+    return options;
+}
+
+// counts the failed checks; the message names the round so a failure can be reproduced
+struct Checker {
+    int failures = 0;
+
+    void expect(bool condition, int round, const std::string& what) {
+        if (condition) return;
+        if (failures < 10) std::cerr << "round " << round << ": " << what << std::endl;
+        failures++;
+    }
+};
+
+// an outer parallelFor over rows whose body runs an inner parallelFor over the columns
+void nestedParallelFor(TaskScheduler& scheduler, int round, Checker& checker) {
+    const size_t rows = 64;
+    const size_t columns = 256;
+    std::vector<uint32_t> cells(rows * columns, 0);
+    scheduler.parallelFor(0, rows, [&](size_t rowBegin, size_t rowEnd) {
+        for (size_t row = rowBegin; row < rowEnd; row++) {
+            scheduler.parallelFor(0, columns, [&, row](size_t begin, size_t end) {
+                for (size_t column = begin; column < end; column++) {
+                    cells[row * columns + column] += (uint32_t)(row * columns + column + round);
+                }
+            }, 16);
+        }
+    }, 1);
+    for (size_t i = 0; i < cells.size(); i++) {
+        // a cell written twice or not at all shows up here
+        if (cells[i] != (uint32_t)(i + round)) {
+            checker.expect(false, round, "nested parallelFor cell " + std::to_string(i) + " is " + std::to_string(cells[i]));
+            return;
+        }
+    }
+}
+
+// chains where every task depends on the one before it, closed by a task depending on every tail;
+// the chain vectors are only safe to touch without a lock if the dependencies serialise them
+void dependencyChains(TaskScheduler& scheduler, int round, Checker& checker) {
+    const int chains = 16;
+    const int length = 32;
+    std::vector<std::vector<int>> order(chains);
+    std::vector<TaskHandle> tails;
+    for (int chain = 0; chain < chains; chain++) {
+        TaskHandle previous;
+        for (int link = 0; link < length; link++) {
+            std::vector<TaskHandle> dependencies;
+            if (previous) dependencies.push_back(previous);
+            previous = scheduler.submit([&order, chain, link]() { order[chain].push_back(link); }, dependencies);
+        }
+        tails.push_back(previous);
+    }
+    std::atomic<int> completeChains{0};
+    TaskHandle join = scheduler.submit([&]() {
+        for (const std::vector<int>& links : order) {
+            if ((int)links.size() == length) completeChains.fetch_add(1, std::memory_order_relaxed);
+        }
+    }, tails);
+    scheduler.wait(join);
+
+    checker.expect(completeChains.load() == chains, round, "join ran before every chain finished");
+    for (int chain = 0; chain < chains; chain++) {
+        bool ordered = (int)order[chain].size() == length;
+        for (int link = 0; ordered && link < length; link++) {
+            ordered = order[chain][link] == link;
+        }
+        checker.expect(ordered, round, "chain " + std::to_string(chain) + " ran out of order");
+    }
+
+    // dependencies that have already finished must not hold a task back
+    TaskHandle late = scheduler.submit([]() {}, tails);
+    scheduler.wait(late);
+}
+
+// tasks that fan out children, each running a parallelFor, and wait for them from inside the task
+void nestedWaits(TaskScheduler& scheduler, int round, Checker& checker) {
+    const int parents = 8;
+    const int children = 8;
+    const size_t range = 1024;
+    std::atomic<uint64_t> total{0};
+    std::vector<TaskHandle> tasks;
+    for (int parent = 0; parent < parents; parent++) {
+        tasks.push_back(scheduler.submit([&]() {
+            std::vector<TaskHandle> spawned;
+            for (int child = 0; child < children; child++) {
+                spawned.push_back(scheduler.submit([&]() {
+                    scheduler.parallelFor(0, range, [&](size_t begin, size_t end) {
+                        uint64_t sum = 0;
+                        for (size_t i = begin; i < end; i++) sum += i;
+                        total.fetch_add(sum, std::memory_order_relaxed);
+                    }, 64);
+                }));
+            }
+            scheduler.wait(spawned);
+        }));
+    }
+    scheduler.wait(tasks);
+    uint64_t expected = (uint64_t)parents * children * (range * (range - 1) / 2);
+    checker.expect(total.load() == expected, round, "nested waits summed " + std::to_string(total.load()) + ", expected " + std::to_string(expected));
+}
+
+int main(int argc, char** argv) {
+    StressOptions options = parseArguments(argc, argv);
+    TaskScheduler scheduler(options.workers);
+    Checker checker;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < options.rounds; round++) {
+        nestedParallelFor(scheduler, round, checker);
+        dependencyChains(scheduler, round, checker);
+        nestedWaits(scheduler, round, checker);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t tasks = 0;
+    uint64_t steals = 0;
+    for (const WorkerStats& stats : scheduler.workerStats()) {
+        tasks += stats.tasks;
+        steals += stats.steals;
+    }
+    // only slot 0 is fed from outside the pool, so workers that ran anything stole it first
+    if (options.workers > 1) {
+        checker.expect(steals > 0, options.rounds, "no task was ever stolen");
+    }
+
+    std::cout << options.rounds << " rounds on " << scheduler.workerSlots() << " slots in " << seconds << " s: "
+              << tasks << " tasks, " << steals << " steals" << std::endl;
+    if (checker.failures > 0) {
+        std::cerr << checker.failures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
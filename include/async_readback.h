@@ -0,0 +1,83 @@
+//
+// Ring of GPU-to-CPU copies that never stalls the pipeline on the common path. request() queues
+// glCopyBufferSubData of some buffer ranges into the next slot followed by a fence; poll() checks
+// the fences without blocking and hands out the newest slot that has landed, so with three
+// slots and one request per frame the CPU reads frame N - 2 while the GPU works on frame N. Slots
+// are persistently and coherently mapped (glBufferStorage, GL 4.4); on a 4.3 context they are
+// plain buffers read with glGetBufferSubData once their fence has signalled.
+//
+
+#ifndef ASYNC_READBACK_H
+#define ASYNC_READBACK_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+
+struct ReadbackRange {
+    GLuint buffer;
+    size_t offset;
+    size_t bytes;
+};
+
+struct ReadbackStats {
+    uint64_t requests = 0;
+    // copies handed out by poll(); the others were overtaken by a newer one first
+    uint64_t delivered = 0;
+    // request() found every slot in flight and had to block on the oldest fence
+    uint64_t stalls = 0;
+    double stallSeconds = 0.0;
+    // from request() to the poll() that first saw the fence signalled, over every landed copy
+    double totalLatencySeconds = 0.0;
+    double maxLatencySeconds = 0.0;
+    uint64_t totalLatencyPolls = 0;
+    uint64_t landed = 0;
+
+    double meanLatencySeconds() const { return landed > 0 ? totalLatencySeconds / landed : 0.0; }
+    // in poll() calls that came back without it, i.e. frames when polled once per frame
+    double meanLatencyPolls() const { return landed > 0 ? (double)totalLatencyPolls / landed : 0.0; }
+};
+
+class AsyncReadback {
+    struct Slot {
+        GLuint buffer = 0;
+        // null unless persistently mapped
+        void* mapped = nullptr;
+        GLsync fence = nullptr;
+        uint64_t tag = 0;
+        std::chrono::steady_clock::time_point requestTime;
+        uint64_t requestPoll = 0;
+    };
+
+    std::vector<Slot> slots;
+    size_t capacity = 0;
+    bool persistent;
+    // slots in flight are oldest, oldest + 1, ... (mod the slot count)
+    size_t oldest = 0;
+    size_t inFlight = 0;
+    uint64_t polls = 0;
+    // the fallback's copy of the slot last handed out
+    std::vector<unsigned char> hostCopy;
+    ReadbackStats stats;
+
+    void allocate(size_t bytes);
+    void land(Slot& slot);
+
+public:
+    explicit AsyncReadback(size_t slotCount = 3);
+    ~AsyncReadback();
+    AsyncReadback(const AsyncReadback&) = delete;
+    AsyncReadback& operator=(const AsyncReadback&) = delete;
+
+    // copies the ranges, packed one after another, into the next slot; the sources must already be
+    // ordered after their writers (GL_BUFFER_UPDATE_BARRIER_BIT). tag comes back out of poll()
+    void request(const std::vector<ReadbackRange>& ranges, uint64_t tag);
+    // the newest copy that has landed since the last call, or null; the data stays valid until the
+    // next request()
+    const void* poll(uint64_t& tag);
+    bool isPersistent() const { return persistent; }
+    const ReadbackStats& getStats() const { return stats; }
+};
+
+#endif //ASYNC_READBACK_H
@@ -0,0 +1,43 @@
+//
+// Barnes-Hut octree solver: O(N log N) approximation of the direct sum. A node is treated
+// as a single point mass when (node width / distance to its centre of mass) < theta.
+//
+
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include <cstdint>
+#include <force_solver.h>
+
+struct OctreeNode {
+    glm::vec3 center;
+    float halfSize;
+    glm::vec3 centerOfMass;
+    float mass;
+    int firstChild;      // index of 8 consecutive children, -1 for leaves
+    int firstParticle;   // range into BarnesHutSolver::particleIndices
+    int particleCount;
+};
+
+class BarnesHutSolver : public ForceSolver {
+    float theta;
+    int leafCapacity;
+    std::vector<OctreeNode> nodes;
+    std::vector<uint32_t> particleIndices;
+    std::vector<uint32_t> scratchIndices;
+
+    void buildTree(const std::vector<glm::vec4>& positions);
+    void subdivide(int nodeIndex, const std::vector<glm::vec4>& positions, int depth);
+    glm::vec3 accelerationAt(uint32_t index, const std::vector<glm::vec4>& positions) const;
+
+public:
+    explicit BarnesHutSolver(float theta = 0.5f, int leafCapacity = 8);
+    void computeAccelerations(const std::vector<glm::vec4>& positions,
+                              std::vector<glm::vec3>& accelerations) override;
+    void computeActiveAccelerations(const std::vector<glm::vec4>& positions,
+                                    const std::vector<uint32_t>& active,
+                                    std::vector<glm::vec3>& accelerations) override;
+    const std::vector<OctreeNode>& getNodes() const { return nodes; }
+};
+
+#endif //BARNES_HUT_H
@@ -9,12 +9,19 @@
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
+// owns the linked program, which is deleted with it (so the GL context has to outlive it)
 struct ComputeShader {
     GLuint id;
     explicit ComputeShader(const char* computeShaderPath);
+    ~ComputeShader();
+    ComputeShader(const ComputeShader&) = delete;
+    ComputeShader& operator=(const ComputeShader&) = delete;
+    ComputeShader(ComputeShader&& other) noexcept;
+    ComputeShader& operator=(ComputeShader&& other) noexcept;
     void use() const;
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
+    void setUint(const std::string &name, unsigned int value) const;
     void setFloat(const std::string &name, float value) const;
     void setVec2(const std::string &name, const glm::vec2 &value) const;
     void setVec2(const std::string &name, float x, float y) const;
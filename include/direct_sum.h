@@ -0,0 +1,49 @@
+//
+// O(N^2) solver with the same pair interaction as the loop in shaders/compute.glsl. Positions are
+// split into padded x/y/z/mass arrays so the inner loop runs over full SIMD batches,
+// and the outer loop is split across all cores. This is the reference the other solvers (and
+// the GPU kernels) are checked against.
+//
+
+#ifndef DIRECT_SUM_H
+#define DIRECT_SUM_H
+
+#include <force_solver.h>
+
+class DirectSumSolver : public ForceSolver {
+    Accumulation accumulation;
+    // padded to a whole number of FloatBatch widths; padding has zero mass
+    std::vector<float> x, y, z, mass;
+
+    void loadPositions(const std::vector<glm::vec4>& positions);
+    glm::vec3 accelerationOf(size_t i) const;
+    glm::vec3 blockedAccelerationOf(size_t i) const;
+
+public:
+    explicit DirectSumSolver(Accumulation accumulation = Accumulation::FLOAT);
+    void computeAccelerations(const std::vector<glm::vec4>& positions,
+                              std::vector<glm::vec3>& accelerations) override;
+    // O(active * N)
+    void computeActiveAccelerations(const std::vector<glm::vec4>& positions,
+                                    const std::vector<uint32_t>& active,
+                                    std::vector<glm::vec3>& accelerations) override;
+};
+
+// Same sum, but every pair is evaluated once and applied to both particles (Newton's third law),
+// which halves the square roots and divisions. Particles are split into blocks and the triangle of
+// block pairs is split evenly across workers; each worker scatters into its own accumulators, and
+// the accumulators are summed at the end.
+class SymmetricDirectSumSolver : public ForceSolver {
+    std::vector<float> x, y, z, mass;
+    // per worker, padded like the positions
+    std::vector<std::vector<float>> accumulators;
+
+    void blockPair(size_t first, size_t second, float* ax, float* ay, float* az) const;
+    void diagonalBlock(size_t block, float* ax, float* ay, float* az) const;
+
+public:
+    void computeAccelerations(const std::vector<glm::vec4>& positions,
+                              std::vector<glm::vec3>& accelerations) override;
+};
+
+#endif //DIRECT_SUM_H
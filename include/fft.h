@@ -0,0 +1,31 @@
+//
+// In-place radix-2 complex FFT on cubic 3D grids, used by the particle-mesh solver. Each pass
+// transforms all lines along one axis, split across cores with parallelFor.
+//
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+class Fft3d {
+    // points per axis, a power of two; grids hold size^3 values indexed (z * size + y) * size + x
+    int size;
+    // exp(-2 pi i k / size) for k < size / 2
+    std::vector<std::complex<float>> twiddles;
+    std::vector<uint32_t> bitReverse;
+
+    void transformLine(std::complex<float>* line, bool inverse) const;
+    void transformAxis(std::vector<std::complex<float>>& grid, size_t stride, bool inverse) const;
+
+public:
+    explicit Fft3d(int size);
+    int getSize() const { return size; }
+    void forward(std::vector<std::complex<float>>& grid) const;
+    // includes the 1 / size^3 normalisation, so inverse(forward(x)) == x
+    void inverse(std::vector<std::complex<float>>& grid) const;
+};
+
+#endif //FFT_H
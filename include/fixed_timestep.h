@@ -0,0 +1,26 @@
+//
+// Accumulator that turns variable frame times into a whole number of fixed simulation steps,
+// so the physics does not depend on the display refresh rate.
+//
+
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+class FixedTimestep {
+    float stepSize;
+    int maxSubsteps;
+    double accumulator = 0.0;
+    long long droppedSteps = 0;
+
+public:
+    FixedTimestep(float stepSize, int maxSubsteps);
+    // adds a frame's worth of wall-clock time and returns how many steps to run this frame, at most
+    // maxSubsteps; time beyond that is dropped so a slow simulation cannot snowball the frame time
+    int advance(float frameTime);
+    float getStepSize() const { return stepSize; }
+    // fraction of a step left over in the accumulator, for blending the last two simulated states
+    float getInterpolationAlpha() const { return (float)(accumulator / stepSize); }
+    long long getDroppedSteps() const { return droppedSteps; }
+};
+
+#endif //FIXED_TIMESTEP_H
@@ -0,0 +1,65 @@
+//
+// Fast multipole solver with Cartesian Taylor expansions (Dehnen 2002 style), O(N) for a fixed
+// order and opening angle. The softened kernel is not harmonic, so the expansions use the full
+// derivative tensors of the radial potential phi(r^2) instead of spherical harmonics: every
+// derivative is a combination of d^k phi / d(r^2)^k, which have closed forms for the softened
+// potential. Cells interact through multipole-to-local translations when
+// (r_A + r_B) < theta * |z_A - z_B|, leaves that are too close sum their particles directly.
+//
+
+#ifndef FMM_H
+#define FMM_H
+
+#include <cstdint>
+#include <force_solver.h>
+
+struct FmmCell {
+    glm::dvec3 center;          // local expansion centre (the box centre)
+    double halfSize;
+    glm::dvec3 centerOfMass;    // multipole expansion centre
+    double radius;              // bounds every particle's distance from centerOfMass
+    int firstChild;             // children are consecutive, only non-empty ones are stored
+    int childCount;
+    int firstParticle;          // range into FmmSolver::particleIndices
+    int particleCount;
+};
+
+class FmmSolver : public ForceSolver {
+    int order;
+    int leafSize;
+    double theta;
+
+    // multi-indices (a, b, c) with a + b + c <= order, and the reverse lookup
+    std::vector<glm::ivec3> terms;
+    std::vector<int> termIndex;
+    std::vector<double> factorials;
+
+    std::vector<FmmCell> cells;
+    std::vector<uint32_t> particleIndices;
+    std::vector<uint32_t> scratchIndices;
+    // cells.size() * terms.size() coefficients each
+    std::vector<double> multipoles;
+    std::vector<double> locals;
+    // per target cell: sources to translate (M2L) and, for leaves, source leaves to sum directly
+    std::vector<std::vector<int>> farLists;
+    std::vector<std::vector<int>> nearLists;
+
+    int indexOf(int a, int b, int c) const { return termIndex[(a * (order + 1) + b) * (order + 1) + c]; }
+    void buildTree(const std::vector<glm::vec4>& positions);
+    void subdivide(int cellIndex, const std::vector<glm::vec4>& positions, int depth);
+    void buildInteractionLists(int target, int source);
+    void computeMultipoles(const std::vector<glm::vec4>& positions);
+    void derivativeTensor(const glm::dvec3& r, std::vector<double>& derivatives) const;
+    void translateMultipoleToLocal(int target, int source, std::vector<double>& derivatives);
+    void translateLocals();
+    glm::vec3 evaluateLeaf(const FmmCell& leaf, const glm::vec4& position, uint32_t index,
+                           const std::vector<glm::vec4>& positions) const;
+
+public:
+    // order is the highest Taylor order kept in the expansions, clamped to [1, 15]
+    explicit FmmSolver(int order = 4, int leafSize = 32, float theta = 0.5f);
+    void computeAccelerations(const std::vector<glm::vec4>& positions,
+                              std::vector<glm::vec3>& accelerations) override;
+};
+
+#endif //FMM_H
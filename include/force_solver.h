@@ -0,0 +1,56 @@
+//
+// Common interface for the CPU gravity solvers.
+//
+
+#ifndef FORCE_SOLVER_H
+#define FORCE_SOLVER_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+enum class ForceSolverType {
+    DIRECT_SUM,
+    // CPU only: evaluates each pair once and applies it to both particles
+    DIRECT_SUM_SYMMETRIC,
+    BARNES_HUT,
+    PARTICLE_MESH,
+    P3M,
+    FMM
+};
+
+// how the direct sums (DirectSumSolver, shaders/compute.glsl and compute_tiled.glsl) add up
+// their pair terms. The pair terms themselves are always fp32; the other modes sum them in fp32
+// over blocks of 128 and only combine the block sums more carefully
+enum class Accumulation {
+    // one fp32 running sum per SIMD lane (per invocation on the GPU)
+    FLOAT,
+    // block sums added with Kahan compensation
+    KAHAN,
+    // block sums added in double
+    DOUBLE
+};
+
+class ForceSolver {
+public:
+    virtual ~ForceSolver() = default;
+
+    // writes the gravitational acceleration acting on every particle given positions with the
+    // mass in w (see ParticleState); drag is velocity dependent and is left to the integrator
+    virtual void computeAccelerations(const std::vector<glm::vec4>& positions,
+                                      std::vector<glm::vec3>& accelerations) = 0;
+
+    // the same, but only for the particles listed in active (every particle still acts as a
+    // source) and leaving the other entries alone; used by block timesteps. The default evaluates
+    // everything, solvers that can aim at a subset override it
+    virtual void computeActiveAccelerations(const std::vector<glm::vec4>& positions,
+                                            const std::vector<uint32_t>& active,
+                                            std::vector<glm::vec3>& accelerations);
+};
+
+// largest per-particle |approx - reference| / |reference|, for checking a solver against the direct sum
+float maxRelativeError(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& approx);
+// sqrt(sum |approx - reference|^2 / sum |reference|^2), less dominated by particles where the net force nearly cancels
+float rmsRelativeError(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& approx);
+
+#endif //FORCE_SOLVER_H
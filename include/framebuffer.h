@@ -0,0 +1,31 @@
+//
+// Offscreen render target (color + depth renderbuffers) that frames can be dumped from.
+//
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <string>
+#include <glad/glad.h>
+
+class OffscreenFramebuffer {
+    GLuint fbo = 0;
+    GLuint colorRenderbuffer = 0;
+    GLuint depthRenderbuffer = 0;
+    int width;
+    int height;
+
+public:
+    OffscreenFramebuffer(int width, int height);
+    ~OffscreenFramebuffer();
+    OffscreenFramebuffer(const OffscreenFramebuffer&) = delete;
+    OffscreenFramebuffer& operator=(const OffscreenFramebuffer&) = delete;
+
+    // binds for drawing and sets the viewport to cover it
+    void bind() const;
+    // reads the color attachment back and writes it as a binary PPM; returns false if the file
+    // could not be written
+    bool writePpm(const std::string& path) const;
+};
+
+#endif //FRAMEBUFFER_H
@@ -0,0 +1,75 @@
+//
+// Compute-shader building blocks for GPU sorting and culling: exclusive prefix sum, stream
+// compaction and a stable LSD radix sort of key-value pairs. They all work on uint SSBOs the caller
+// owns, keep their own scratch buffers (grown on demand), and need a current GL 4.3 context. Work
+// is only issued; the caller sees the results after the next GL_SHADER_STORAGE_BARRIER_BIT (or
+// a readback). Dispatch limits cap the element count at 65535 * 256.
+//
+
+#ifndef GPU_PRIMITIVES_H
+#define GPU_PRIMITIVES_H
+
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <compute_shader.h>
+
+// (re)allocates buffer to hold at least bytes, contents are not preserved
+void ensureBufferSize(GLuint& buffer, size_t& capacity, size_t bytes);
+
+class GpuScan {
+    ComputeShader scanShader;
+    ComputeShader addShader;
+    // block totals of every recursion level
+    std::vector<GLuint> levelBuffers;
+    std::vector<size_t> levelCapacities;
+
+    void scanLevel(GLuint input, GLuint output, uint32_t count, size_t level);
+
+public:
+    GpuScan();
+    ~GpuScan();
+    GpuScan(const GpuScan&) = delete;
+    GpuScan& operator=(const GpuScan&) = delete;
+    // output[i] = input[0] + ... + input[i - 1]; input and output may be the same buffer
+    void exclusiveScan(GLuint input, GLuint output, uint32_t count);
+};
+
+class GpuCompaction {
+    GpuScan scan;
+    ComputeShader compactShader;
+    GLuint offsetBuffer = 0;
+    size_t offsetCapacity = 0;
+
+public:
+    GpuCompaction();
+    ~GpuCompaction();
+    GpuCompaction(const GpuCompaction&) = delete;
+    GpuCompaction& operator=(const GpuCompaction&) = delete;
+    // writes the values whose flag is non-zero to the front of output in their original order and
+    // returns how many there are (the only part that waits for the GPU)
+    uint32_t compact(GLuint flags, GLuint values, GLuint output, uint32_t count);
+};
+
+class GpuRadixSort {
+    GpuScan scan;
+    ComputeShader histogramShader;
+    ComputeShader scatterShader;
+    GLuint keyScratch = 0;
+    GLuint valueScratch = 0;
+    GLuint countBuffer = 0;
+    size_t keyCapacity = 0;
+    size_t valueCapacity = 0;
+    size_t countCapacity = 0;
+
+public:
+    GpuRadixSort();
+    ~GpuRadixSort();
+    GpuRadixSort(const GpuRadixSort&) = delete;
+    GpuRadixSort& operator=(const GpuRadixSort&) = delete;
+    // stable sort of count keys with their uint values by the low keyBits bits, 4 bits per pass.
+    // Keys up to 32 bits are one uint each, wider ones (up to 64) are (low, high) uint pairs.
+    void sort(GLuint keys, GLuint values, uint32_t count, int keyBits = 32);
+};
+
+#endif //GPU_PRIMITIVES_H
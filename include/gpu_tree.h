@@ -0,0 +1,63 @@
+//
+// Linear BVH over the particles, built entirely on the GPU from their Morton keys (Karras 2012):
+// keys from shaders/morton_keys.glsl, sorted with GpuRadixSort, internal nodes from the sorted
+// keys in parallel, then a bottom-up mass / centre of mass / bounding box reduction. The nodes stay
+// in an SSBO for shaders/compute_tree.glsl to walk, so positions never leave the GPU.
+//
+
+#ifndef GPU_TREE_H
+#define GPU_TREE_H
+
+#include <cstdint>
+#include <glad/glad.h>
+#include <compute_shader.h>
+#include <gpu_primitives.h>
+
+// std430 layout of a node in shaders/lbvh_build.glsl and shaders/compute_tree.glsl. Nodes
+// 0 .. count - 2 are internal with node 0 the root, count - 1 + k is the leaf of the particle
+// order()[k]
+struct GpuTreeNode {
+    float centerOfMass[4];  // w = mass
+    float lower[4];
+    float upper[4];
+    uint32_t links[4];      // left child, right child, parent (0xffffffff for none)
+};
+
+class GpuTree {
+    GpuRadixSort sort;
+    ComputeShader mortonShader;
+    ComputeShader buildShader;
+    GLuint keyBuffer = 0;
+    GLuint orderBuffer = 0;
+    GLuint boundsBuffer = 0;
+    GLuint nodeBuffer = 0;
+    GLuint arrivalBuffer = 0;
+    // one uint, bumped by compute_tree.glsl for every walk that ran out of stack
+    GLuint overflowBuffer = 0;
+    size_t keyCapacity = 0;
+    size_t orderCapacity = 0;
+    size_t boundsCapacity = 0;
+    size_t nodeCapacity = 0;
+    size_t arrivalCapacity = 0;
+    uint32_t count = 0;
+
+public:
+    GpuTree();
+    ~GpuTree();
+    GpuTree(const GpuTree&) = delete;
+    GpuTree& operator=(const GpuTree&) = delete;
+    // allocates the buffers for count particles; order() holds the identity permutation until
+    // the first build
+    void reserve(uint32_t count);
+    // positions is a vec4 SSBO (w = mass) of count particles
+    void build(GLuint positions, uint32_t count);
+    GLuint nodes() const { return nodeBuffer; }
+    GLuint order() const { return orderBuffer; }
+    GLuint stackOverflowCounter() const { return overflowBuffer; }
+    // walks that overflowed their stack since reserve() first ran; each of them took a node it
+    // should have opened as a point mass. Reads the counter back, so it waits for the GPU
+    uint32_t readStackOverflows() const;
+    uint32_t nodeCount() const { return count == 0 ? 0 : 2 * count - 1; }
+};
+
+#endif //GPU_TREE_H
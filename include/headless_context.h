@@ -0,0 +1,25 @@
+//
+// GL 4.3 core context without a window, for render farm nodes and CI. Uses EGL on the Mesa
+// surfaceless platform when available (works with llvmpipe and no display server), and falls back
+// to the default EGL display with a 1x1 pbuffer otherwise.
+//
+
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <EGL/egl.h>
+
+class HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+
+public:
+    // makes the context current and loads the GL function pointers; throws std::runtime_error on failure
+    HeadlessContext();
+    ~HeadlessContext();
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+};
+
+#endif //HEADLESS_CONTEXT_H
@@ -0,0 +1,34 @@
+//
+// Fourth-order Hermite predictor-corrector (Makino & Aarseth 1992). Every particle is predicted to
+// the evaluation time with its acceleration and jerk (da/dt) by a Taylor series, the acceleration
+// and jerk are evaluated there from the same pair loop, and the two endpoints' a and jerk give the
+// snap and crackle that correct the prediction to fourth order. The same pair terms are in
+// shaders/compute_hermite.glsl.
+//
+
+#ifndef HERMITE_H
+#define HERMITE_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// direct sum of the softened gravity and its time derivative, vectorised like DirectSumSolver
+class HermiteDirectSum {
+    // padded to a whole number of FloatBatch widths; padding has zero mass
+    std::vector<float> x, y, z, vx, vy, vz, mass;
+
+public:
+    // acceleration and jerk for the particles listed in active, from everyone's positions (mass in
+    // w) and velocities; the other entries are left alone
+    void evaluate(const std::vector<glm::vec4>& positions, const std::vector<glm::vec4>& velocities,
+                  const std::vector<uint32_t>& active,
+                  std::vector<glm::vec3>& accelerations, std::vector<glm::vec3>& jerks);
+};
+
+// Aarseth's timestep sqrt(eta (|a| |a2| + |a1|^2) / (|a1| |a3| + |a2|^2)) from the acceleration
+// and its first three derivatives
+double aarsethTimestep(const glm::vec3& acceleration, const glm::vec3& jerk,
+                       const glm::vec3& snap, const glm::vec3& crackle, float eta);
+
+#endif //HERMITE_H
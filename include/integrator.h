@@ -0,0 +1,34 @@
+//
+// Time integrators, written as kick/drift splittings so the CPU and GPU paths run exactly the
+// same sequence of operations: each stage does v += kick * dt * a(x) followed by
+// x += drift * dt * v. A stage whose positions have not moved since the last force evaluation
+// reuses the cached accelerations, which is what makes kick-drift-kick leapfrog cost one force
+// evaluation per step.
+//
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <vector>
+
+enum class IntegratorType {
+    // semi-implicit Euler, what compute.glsl originally did (first order)
+    EULER,
+    // kick-drift-kick leapfrog / velocity Verlet (second order, symplectic)
+    LEAPFROG,
+    // Yoshida's fourth-order composition of three leapfrog steps, three force evaluations per step
+    YOSHIDA4,
+    // fourth-order Hermite predictor-corrector (see hermite.h), one acceleration + jerk evaluation
+    // per step. Not a kick/drift splitting: it has no stage table and ParticleSystem runs it itself
+    HERMITE4
+};
+
+struct IntegratorStage {
+    float kick;
+    float drift;
+};
+
+// HERMITE4 has no stages and gets the Euler table
+const std::vector<IntegratorStage>& integratorStages(IntegratorType type);
+
+#endif //INTEGRATOR_H
@@ -0,0 +1,30 @@
+//
+// Morton (Z-order) keys and a parallel LSD radix sort, used to reorder particles so that bodies
+// close in space are also close in memory.
+//
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// 21 bits per axis interleaved as ...z1y1x1z0y0x0, positions normalised to their bounding box
+void computeMortonKeys(const std::vector<glm::vec4>& positions, std::vector<uint64_t>& keys);
+
+// stable sort of keys (8 bits per pass, passes where every key shares the digit are skipped);
+// order receives, for every sorted slot, the index the key had before sorting
+void radixSortByKey(std::vector<uint64_t>& keys, std::vector<uint32_t>& order);
+
+// out[i] = in[order[i]]
+template <typename T>
+void permute(std::vector<T>& values, const std::vector<uint32_t>& order, std::vector<T>& scratch) {
+    scratch.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        scratch[i] = values[order[i]];
+    }
+    values.swap(scratch);
+}
+
+#endif //MORTON_H
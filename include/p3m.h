@@ -0,0 +1,45 @@
+//
+// P3M (particle-particle/particle-mesh) solver. The softened pair force f(r) = G m / (r^2 + softening)
+// is split with the Gaussian window S(r) = erfc(r / 2r_s) + r / (r_s sqrt(pi)) exp(-r^2 / 4r_s^2):
+// the mesh solves for the smooth part f (1 - S) and the short-range part f S is summed directly over
+// pairs closer than the cutoff, found through a cell list. r_s is tied to the mesh spacing, so
+// clustered regions keep direct-sum accuracy while the all-pairs work stays local.
+//
+
+#ifndef P3M_H
+#define P3M_H
+
+#include <cstdint>
+#include <particle_mesh.h>
+
+class P3MSolver : public ParticleMeshSolver {
+    float splitScale = 0.0f;   // r_s
+    float cutoff = 0.0f;       // short-range pairs beyond this are dropped, S(cutoff) ~ 4e-4
+    // mesh potential of a unit mass tabulated on [0, potentialRange]; the plain softened potential beyond
+    std::vector<float> potentialTable;
+    float potentialRange = 0.0f;
+    // S(r) tabulated over r^2 in [0, cutoff^2]
+    std::vector<float> windowTable;
+
+    // cell list for the short-range pass, cells at least cutoff wide
+    glm::vec3 cellOrigin = glm::vec3(0.0f);
+    float cellWidth = 0.0f;
+    int cellsX = 0, cellsY = 0, cellsZ = 0;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> sortedIndices;
+    std::vector<glm::vec4> sortedPositions;
+
+    void buildCellList(const std::vector<glm::vec4>& positions);
+    glm::vec3 shortRangeAcceleration(const glm::vec4& position, uint32_t index) const;
+
+protected:
+    void computeGreensFunction() override;
+    float meshPotential(float r) const override;
+
+public:
+    explicit P3MSolver(int meshSize = 64);
+    void computeAccelerations(const std::vector<glm::vec4>& positions,
+                              std::vector<glm::vec3>& accelerations) override;
+};
+
+#endif //P3M_H
@@ -0,0 +1,18 @@
+//
+// Minimal fork-join helper for the CPU solvers.
+//
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+unsigned int workerCount();
+
+// splits [begin, end) into contiguous chunks of at least minChunk elements (a few per worker) and
+// calls body(chunkBegin, chunkEnd) on each of them on the shared TaskScheduler (see
+// task_scheduler.h); returns once every chunk is done. Ranges shorter than 2 * minChunk run inline.
+void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t minChunk = 64);
+
+#endif //PARALLEL_H
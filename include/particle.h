@@ -5,13 +5,21 @@
 #ifndef PARTICLE_H
 #define PARTICLE_H
 
+#include <cstdint>
+#include <vector>
 #include <glm/glm.hpp>
 
-struct Particle {
-    glm::vec4 position;
-    glm::vec4 velocity;
-    float mass;
-    float padding[3];
+// Particle state as separate arrays rather than one padded struct per particle, so the force
+// loops only stream 16 bytes per body. The GPU mirrors this with one SSBO per array.
+struct ParticleState {
+    // xyz = position, w = mass
+    std::vector<glm::vec4> positions;
+    // xyz = velocity, w unused
+    std::vector<glm::vec4> velocities;
+    // stable id of the body in each slot; slots are reordered when particles are sorted
+    std::vector<uint32_t> ids;
+
+    size_t size() const { return positions.size(); }
 };
 
 #endif //PARTICLE_H
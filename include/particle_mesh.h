@@ -0,0 +1,51 @@
+//
+// Particle-mesh solver: O(N + M log M) for M mesh cells. Masses are deposited on a meshSize^3 grid
+// with cloud-in-cell weights, the potential is the convolution with the softened point-mass
+// potential done by FFT on a zero-padded (2 meshSize)^3 grid (isolated boundaries, no periodic
+// images), and accelerations are finite-difference gradients interpolated back with the same
+// weights. Forces are smoothed below a couple of cells, so accuracy depends on the mesh spacing
+// relative to the softening length.
+//
+
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+
+#include <complex>
+#include <fft.h>
+#include <force_solver.h>
+
+class ParticleMeshSolver : public ForceSolver {
+    int meshSize;
+    Fft3d fft;
+    // mesh placement for the current step
+    glm::vec3 origin = glm::vec3(0.0f);
+    std::vector<std::complex<float>> greensFunction;
+    std::vector<std::complex<float>> paddedGrid;
+    // one density grid per worker, summed after the deposit
+    std::vector<std::vector<float>> partialDensities;
+    std::vector<float> potential;
+    std::vector<glm::vec3> meshAccelerations;
+
+    void fitMesh(const std::vector<glm::vec4>& positions);
+    void depositMass(const std::vector<glm::vec4>& positions);
+    void solvePotential();
+    void differentiatePotential();
+
+protected:
+    // mesh spacing; kept between steps while the particles still fit reasonably well so the
+    // transformed Green's function can be reused
+    float cellSize = 0.0f;
+
+    // called whenever cellSize changes; transforms meshPotential sampled on the padded grid
+    virtual void computeGreensFunction();
+    // potential of a unit mass at distance r that the mesh solves for
+    virtual float meshPotential(float r) const;
+
+public:
+    // meshSize is rounded up to a power of two
+    explicit ParticleMeshSolver(int meshSize = 64);
+    void computeAccelerations(const std::vector<glm::vec4>& positions,
+                              std::vector<glm::vec3>& accelerations) override;
+};
+
+#endif //PARTICLE_MESH_H
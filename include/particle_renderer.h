@@ -0,0 +1,35 @@
+//
+// Draws particle state handed over from another thread (see SimulationThread) with the same
+// shaders and vertex layout as ParticleSystem::render, from buffers of its own.
+//
+
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <shader.h>
+#include <simulation_thread.h>
+
+class ParticleRenderer {
+    Shader* pipelineShaders;
+    GLuint vao = 0;
+    // attribute locations 0, 1 and 2 of shaders/vertex.glsl
+    GLuint positionBuffer = 0;
+    GLuint velocityBuffer = 0;
+    GLuint previousPositionBuffer = 0;
+    size_t capacity = 0;
+    size_t count = 0;
+
+public:
+    explicit ParticleRenderer(Shader* pipelineShaders);
+    ~ParticleRenderer();
+    ParticleRenderer(const ParticleRenderer&) = delete;
+    ParticleRenderer& operator=(const ParticleRenderer&) = delete;
+
+    // copies the frame into the vertex buffers, growing them when the count changed
+    void upload(const SimulationFrame& frame);
+    void render(const glm::mat4& view, const glm::mat4& projection, float interpolationAlpha);
+};
+
+#endif //PARTICLE_RENDERER_H
@@ -5,25 +5,242 @@
 #ifndef PARTICLESYSTEM_H
 #define PARTICLESYSTEM_H
 
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 #include <glad/glad.h>
 #include <particle.h>
 #include <shader.h>
 #include <compute_shader.h>
+#include <async_readback.h>
+#include <force_solver.h>
+#include <gpu_primitives.h>
+#include <gpu_tree.h>
+#include <hermite.h>
+#include <integrator.h>
+#include <profiler.h>
+
+class MappedSnapshot;
+
+enum class SimulationBackend {
+    GPU,
+    // runs the physics on the CPU; needs no GL context unless render() is used
+    CPU
+};
+
+// compute programs implementing the GPU direct sum, all with 128-wide workgroups
+enum class GpuKernel {
+    // shaders/compute.glsl, every invocation streams all particles from the SSBO
+    DIRECT_SUM,
+    // shaders/compute_tiled.glsl, positions staged through shared memory a workgroup at a time
+    TILED,
+    // shaders/compute_tree.glsl, Barnes-Hut walk of the GPU-built linear BVH (see gpu_tree.h)
+    TREE,
+    // shaders/compute_hermite.glsl, Hermite predictor-corrector over the direct sum
+    HERMITE
+};
+
+const char* gpuKernelPath(GpuKernel kernel);
+
+struct ParticleSystemSettings {
+    int numParticles = 30000;
+    SimulationBackend backend = SimulationBackend::GPU;
+    // on the GPU backend DIRECT_SUM runs the all-pairs loop in directSumKernel and BARNES_HUT walks
+    // a tree built on the GPU (see gpuKernelFor); the other solvers always run on the CPU
+    ForceSolverType solver = ForceSolverType::DIRECT_SUM;
+    // DIRECT_SUM or TILED
+    GpuKernel directSumKernel = GpuKernel::DIRECT_SUM;
+    // Barnes-Hut opening angle, smaller is more accurate and slower. The GPU tree measures its
+    // nodes differently from the CPU octree, scaled so one theta gives both about the same accuracy
+    float theta = 0.5f;
+    // particle-mesh (and P3M) grid points per axis, rounded up to a power of two
+    int meshSize = 64;
+    // fast multipole expansion order and particles per leaf cell
+    int fmmOrder = 4;
+    int fmmLeafSize = 32;
+    // HERMITE4 always sums directly (on the CPU with HermiteDirectSum, whatever the solver, on
+    // the GPU with shaders/compute_hermite.glsl and a shared step)
+    IntegratorType integrator = IntegratorType::EULER;
+    // when set, the initial state is loaded from this snapshot instead of being generated (and
+    // numParticles is ignored)
+    std::string restartPath;
+    // writes a snapshot to checkpointPath every checkpointInterval steps, 0 disables
+    int checkpointInterval = 0;
+    std::string checkpointPath = "checkpoint.nbody";
+    // reorders all particle arrays by Morton key every sortInterval steps, 0 disables
+    int sortInterval = 0;
+    // block timesteps (CPU only): every particle steps with deltaTime / 2^level for a
+    // level up to maxTimestepLevel chosen from eta * |a| / |da/dt|, and only the particles at the
+    // end of their step are evaluated. Kick-drift-kick leapfrog unless the integrator is
+    // HERMITE4, which picks levels from Aarseth's criterion instead. 0 disables
+    int maxTimestepLevel = 0;
+    // eta of either timestep criterion
+    float timestepAccuracy = 0.02f;
+    // how the direct sums add up their fp32 pair terms (see Accumulation). Any mode but FLOAT also
+    // keeps the fp32 rounding error of every drift in a per-particle residual that is folded into
+    // the next one, so positions effectively carry twice fp32's precision; that part applies to the
+    // CPU shared and block steps and to compute.glsl/compute_tiled.glsl, not to Hermite or the tree
+    Accumulation accumulation = Accumulation::FLOAT;
+    // GPU path: every readbackInterval steps the state is queued into an AsyncReadback ring, and
+    // pollReadback() hands out the newest copy that has arrived (typically two requests old)
+    // without stalling the pipeline. 0 disables
+    int readbackInterval = 0;
+};
+
+struct SortStats {
+    uint64_t sorts = 0;
+    double lastSeconds = 0.0;
+    double totalSeconds = 0.0;
+};
+
+struct BlockStepStats {
+    // points in time where some particles were evaluated, over all update() calls
+    uint64_t substeps = 0;
+    // particle force evaluations; a shared step at the finest level in use would have needed
+    // substeps * N
+    uint64_t evaluations = 0;
+    uint64_t particleSubsteps = 0;
+};
+
+// the compute program a GPU-backend system with these settings expects to be given
+GpuKernel gpuKernelFor(const ParticleSystemSettings& settings);
+
+// the CPU solver the settings ask for, or null when the physics runs in a compute shader
+std::unique_ptr<ForceSolver> createForceSolver(const ParticleSystemSettings& settings);
 
 class ParticleSystem {
     Shader* pipelineShaders;
     ComputeShader* computeShader;
-    GLuint vao;
-    GLuint shaderStorageBufferObject;
-    std::vector<Particle> particles;
-    const int NUM_PARTICLES = 30000;
+    ParticleSystemSettings settings;
+    // ping-pong pairs: the compute pass reads positionBuffers/velocityBuffers[currentBuffer] and
+    // writes the other one, then the two swap. Each pair has its own VAO so rendering follows the
+    // current one.
+    GLuint vaos[2] = {0, 0};
+    GLuint positionBuffers[2] = {0, 0};
+    GLuint velocityBuffers[2] = {0, 0};
+    int currentBuffer = 0;
+    // gravitational accelerations from the last force evaluation (GPU path)
+    GLuint accelerationBuffer = 0;
+    // positions before the latest update(), blended with the current ones when rendering
+    GLuint previousPositionBuffer = 0;
+    // particle ids, permuted alongside the other buffers when the GPU path sorts
+    GLuint idBuffer = 0;
+    // drift rounding residuals (xyz) when settings.accumulation is not FLOAT, bound at 5
+    GLuint residualBuffer = 0;
+    size_t particleCount = 0;
+    // on the GPU backend a system restarted from a snapshot leaves this empty until readState()
+    ParticleState state;
+    std::vector<glm::vec4> previousPositions;
+    // set when the physics runs on the CPU, the GPU buffer is then only a copy for rendering
+    std::unique_ptr<ForceSolver> forceSolver;
+    std::vector<glm::vec3> accelerations;
+    // what the positions lack to the exact sum of their drifts, see settings.accumulation
+    std::vector<glm::vec3> positionResiduals;
+    // true while the positions are unchanged since the accelerations were last evaluated
+    bool accelerationsCurrent = false;
+    bool gpuBufferStale = false;
+
+    uint64_t stepCount = 0;
+    double simulationTime = 0.0;
+
+    std::vector<uint64_t> sortKeys;
+    std::vector<uint32_t> sortOrder;
+    SortStats sortStats;
+
+    // block timesteps: per particle level, end of the current step in ticks of
+    // deltaTime / 2^maxTimestepLevel, and the last two evaluations for the jerk estimate
+    std::vector<uint8_t> timestepLevels;
+    std::vector<uint32_t> stepEnds;
+    std::vector<glm::vec3> previousAccelerations;
+    std::vector<double> evaluationTimes;
+    std::vector<double> previousEvaluationTimes;
+    std::vector<uint32_t> activeParticles;
+    BlockStepStats blockStepStats;
+
+    // Hermite: jerks next to accelerations (both including drag), the state every particle is
+    // predicted to at each tick, the tick each particle was last corrected at, and the Aarseth
+    // timestep from that correction
+    HermiteDirectSum hermite;
+    std::vector<glm::vec3> jerks;
+    std::vector<glm::vec3> previousJerks;
+    std::vector<glm::vec4> predictedPositions;
+    std::vector<glm::vec4> predictedVelocities;
+    std::vector<uint32_t> particleTicks;
+    std::vector<float> hermiteTimesteps;
+    // GPU path: jerks beside accelerationBuffer
+    GLuint jerkBuffer = 0;
+    // GPU path reorder: keys from shaders/morton_keys.glsl, sorted by GpuRadixSort and applied
+    // to every buffer with shaders/gather.glsl, created on the first sort
+    std::unique_ptr<GpuRadixSort> gpuSort;
+    std::unique_ptr<ComputeShader> mortonShader;
+    std::unique_ptr<ComputeShader> gatherShader;
+    GLuint sortKeyBuffer = 0;
+    GLuint sortIndexBuffer = 0;
+    GLuint boundsBuffer = 0;
+    GLuint gatherScratchBuffer = 0;
+    // rebuilt before every force evaluation when the GPU path runs Barnes-Hut
+    std::unique_ptr<GpuTree> gpuTree;
+    // settings.readbackInterval: positions, velocities and ids packed per slot, and the latest
+    // one that arrived unpacked into readbackState
+    std::unique_ptr<AsyncReadback> readback;
+    ParticleState readbackState;
+    // not owned, null unless setProfiler() was called
+    Profiler* profiler = nullptr;
+
+    void generateInitialConditions();
+    // copies the arrays into state only if the physics runs on the CPU, the GPU buffers are
+    // seeded straight from the mapping instead
+    void loadSnapshot(const MappedSnapshot& snapshot);
+    void advance(float deltaTime);
+    void dispatchStage(const IntegratorStage& stage, float deltaTime, bool evaluateForces);
+    void stepOnCpu(float deltaTime);
+    void stepBlocks(float deltaTime);
+    int blockLevel(double timestep, float deltaTime, uint32_t tick) const;
+    int timestepLevel(size_t i, float deltaTime, uint32_t tick) const;
+    void evaluateHermite(const std::vector<uint32_t>& active);
+    void stepHermite(float deltaTime);
+    void dispatchHermite(float deltaTime);
+    void uploadState();
+    void sortParticles();
+    void sortOnGpu();
+    void gather(GLuint input, GLuint output, uint32_t wordsPerElement);
+    void requestReadback();
 
 public:
-    ParticleSystem(Shader* pipelineShaders, ComputeShader* computeShader);
+    // pipelineShaders and computeShader may be null for a headless CPU-backend system, in which
+    // case no GL calls are made at all
+    ParticleSystem(Shader* pipelineShaders, ComputeShader* computeShader,
+                   const ParticleSystemSettings& settings = ParticleSystemSettings());
+    ~ParticleSystem();
     void update(float deltaTime);
-    void render(const glm::mat4& view, const glm::mat4& projection);
-    void render(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection);
+    // current particle state; on the GPU backend this reads the SSBOs back first
+    const ParticleState& readState();
+    // gravitational accelerations from the last force evaluation (without drag), read back from
+    // the GPU on that backend; empty before the first evaluation on the CPU backend
+    const std::vector<glm::vec3>& readAccelerations();
+    // settings.readbackInterval: the newest state copy that arrived since the last call, or null;
+    // step receives the step it was taken after. Stays valid until the next call that returns
+    // one. On the CPU backend this is simply the current state
+    const ParticleState* pollReadback(uint64_t* step = nullptr);
+    // GPU tree walks that ran out of stack so far (see GpuTree::readStackOverflows), 0 without a GPU tree
+    uint32_t readTreeStackOverflows() const { return gpuTree ? gpuTree->readStackOverflows() : 0; }
+    // times update() and render() and their main passes from now on; null stops it. The profiler
+    // must only time the GPU when this system has a GL context
+    void setProfiler(Profiler* profiler) { this->profiler = profiler; }
+    // null unless the GPU path has readbacks enabled
+    const ReadbackStats* getReadbackStats() const { return readback ? &readback->getStats() : nullptr; }
+    bool saveSnapshot(const std::string& path);
+    // the settings as the system runs them, after the constructor's clamping
+    const ParticleSystemSettings& getSettings() const { return settings; }
+    uint64_t getStepCount() const { return stepCount; }
+    double getSimulationTime() const { return simulationTime; }
+    // cost of the Morton reorders so far; totalSeconds / getStepCount() is the amortised cost per step
+    const SortStats& getSortStats() const { return sortStats; }
+    const BlockStepStats& getBlockStepStats() const { return blockStepStats; }
+    // interpolationAlpha blends from the state before the last update() (0) to the current one (1)
+    void render(const glm::mat4& view, const glm::mat4& projection, float interpolationAlpha = 1.0f);
+    void render(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float interpolationAlpha = 1.0f);
 };
 
 #endif //PARTICLESYSTEM_H
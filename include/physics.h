@@ -0,0 +1,15 @@
+//
+// Physical constants shared by the CPU solvers. These mirror the values hard-coded in
+// shaders/compute.glsl, so the two need to be kept in sync.
+//
+
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+namespace PhysicsConstants {
+    const float G = 6.67430e-11f;
+    const float SOFTENING = 0.1f;
+    const float DRAG = 0.1f;
+};
+
+#endif //PHYSICS_H
@@ -0,0 +1,119 @@
+//
+// Scoped CPU and GPU pass timers. Every pass records the wall clock around its scope and, when GPU
+// timing is on, a GL_TIMESTAMP query at each end (timestamps rather than GL_TIME_ELAPSED so passes
+// can nest). Queries go into a ring of frames and are only read once available, several frames
+// later, so the profiler never waits for the GPU; a frame whose queries are still pending when
+// its slot comes round again is dropped instead. Every pass keeps a rolling window of samples that
+// is summarised as min/avg/p99 in milliseconds.
+//
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <trace.h>
+
+struct TimingSummary {
+    size_t samples = 0;
+    double min = 0.0;
+    double avg = 0.0;
+    double p99 = 0.0;
+};
+
+struct PassTimings {
+    std::string name;
+    // nesting level, for indenting
+    int depth;
+    TimingSummary cpu;
+    TimingSummary gpu;
+};
+
+class Profiler {
+    // a pass is identified by its name and its parent, so the same name under two parents gives
+    // two passes
+    struct Pass {
+        std::string name;
+        size_t parent;
+        int depth;
+        std::deque<double> cpuSamples;
+        std::deque<double> gpuSamples;
+    };
+    struct Record {
+        size_t pass;
+        GLuint beginQuery;
+        GLuint endQuery;
+    };
+    struct Frame {
+        std::vector<Record> records;
+        // timestamp query objects, reused from frame to frame
+        std::vector<GLuint> queries;
+        size_t usedQueries = 0;
+    };
+    struct OpenPass {
+        size_t pass;
+        int64_t cpuStart;
+        size_t record;
+    };
+
+    bool gpuTiming;
+    size_t window;
+    std::vector<Pass> passes;
+    std::vector<Frame> frames;
+    size_t currentFrame = 0;
+    std::vector<OpenPass> openPasses;
+    uint64_t droppedFrames = 0;
+
+    size_t passIndex(const char* name);
+    GLuint nextQuery(Frame& frame);
+    // reads the frame's queries back if they are all available, returns false otherwise
+    bool collect(Frame& frame);
+    static void addSample(std::deque<double>& samples, double milliseconds, size_t window);
+    static TimingSummary summarise(const std::deque<double>& samples);
+
+public:
+    // gpuTiming needs a current GL context for every call; frameLatency is how many frames the
+    // queries get to complete, window how many samples each pass keeps
+    explicit Profiler(bool gpuTiming = true, size_t frameLatency = 4, size_t window = 240);
+    ~Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // starts a new frame, collecting whatever older frames have finished
+    void beginFrame();
+    void beginPass(const char* name);
+    void endPass();
+
+    // every pass in tree order: each parent directly followed by its children, siblings in the
+    // order they were first seen
+    std::vector<PassTimings> timings() const;
+    // frames whose GPU results were discarded because they were still pending a ring later
+    uint64_t getDroppedFrames() const { return droppedFrames; }
+    void print(std::ostream& out) const;
+    // one row per pass in timings() order (a row's parent is the nearest row above it with a smaller
+    // depth): pass,depth,cpu_samples,cpu_min_ms,cpu_avg_ms,cpu_p99_ms,gpu_samples,...
+    bool writeCsv(const std::string& path) const;
+};
+
+// beginPass/endPass around a scope (skipped when profiler is null), which also goes into the
+// trace when one is recording
+class ProfileScope {
+    Profiler* profiler;
+    TraceScope trace;
+
+public:
+    ProfileScope(Profiler* profiler, const char* name) : profiler(profiler), trace(name) {
+        if (profiler != nullptr) profiler->beginPass(name);
+    }
+    ~ProfileScope() {
+        if (profiler != nullptr) profiler->endPass();
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#endif //PROFILER_H
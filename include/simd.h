@@ -0,0 +1,124 @@
+//
+// Thin wrapper over the widest float vector the compiler was told it can use (AVX-512, AVX2,
+// SSE2, or plain scalar code), so the CPU kernels are written once and recompiled per target.
+//
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__)
+
+struct FloatBatch {
+    static constexpr int WIDTH = 16;
+    __m512 v;
+
+    static FloatBatch load(const float* p) { return {_mm512_loadu_ps(p)}; }
+    static FloatBatch broadcast(float x) { return {_mm512_set1_ps(x)}; }
+    void store(float* p) const { _mm512_storeu_ps(p, v); }
+    friend FloatBatch operator+(FloatBatch a, FloatBatch b) { return {_mm512_add_ps(a.v, b.v)}; }
+    friend FloatBatch operator-(FloatBatch a, FloatBatch b) { return {_mm512_sub_ps(a.v, b.v)}; }
+    friend FloatBatch operator*(FloatBatch a, FloatBatch b) { return {_mm512_mul_ps(a.v, b.v)}; }
+    friend FloatBatch operator/(FloatBatch a, FloatBatch b) { return {_mm512_div_ps(a.v, b.v)}; }
+    // the zero-masked forms here and in sum(): GCC expands the unmasked ones around an
+    // _mm512_undefined_* register, which -Wall reports as maybe-uninitialized
+    friend FloatBatch sqrt(FloatBatch a) { return {_mm512_maskz_sqrt_ps(0xffff, a.v)}; }
+    // a * b + c
+    friend FloatBatch fma(FloatBatch a, FloatBatch b, FloatBatch c) { return {_mm512_fmadd_ps(a.v, b.v, c.v)}; }
+    // value where test > 0, zero elsewhere
+    friend FloatBatch maskPositive(FloatBatch test, FloatBatch value) {
+        return {_mm512_maskz_mov_ps(_mm512_cmp_ps_mask(test.v, _mm512_setzero_ps(), _CMP_GT_OQ), value.v)};
+    }
+    float sum() const {
+        __m512d halves = _mm512_castps_pd(v);
+        __m256 quarter = _mm256_add_ps(_mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xf, halves, 0)),
+                                       _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xf, halves, 1)));
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(quarter), _mm256_extractf128_ps(quarter, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        return _mm_cvtss_f32(half);
+    }
+};
+
+#elif defined(__AVX2__)
+
+struct FloatBatch {
+    static constexpr int WIDTH = 8;
+    __m256 v;
+
+    static FloatBatch load(const float* p) { return {_mm256_loadu_ps(p)}; }
+    static FloatBatch broadcast(float x) { return {_mm256_set1_ps(x)}; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    friend FloatBatch operator+(FloatBatch a, FloatBatch b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend FloatBatch operator-(FloatBatch a, FloatBatch b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend FloatBatch operator*(FloatBatch a, FloatBatch b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend FloatBatch operator/(FloatBatch a, FloatBatch b) { return {_mm256_div_ps(a.v, b.v)}; }
+    friend FloatBatch sqrt(FloatBatch a) { return {_mm256_sqrt_ps(a.v)}; }
+#if defined(__FMA__)
+    friend FloatBatch fma(FloatBatch a, FloatBatch b, FloatBatch c) { return {_mm256_fmadd_ps(a.v, b.v, c.v)}; }
+#else
+    friend FloatBatch fma(FloatBatch a, FloatBatch b, FloatBatch c) { return a * b + c; }
+#endif
+    friend FloatBatch maskPositive(FloatBatch test, FloatBatch value) {
+        return {_mm256_and_ps(_mm256_cmp_ps(test.v, _mm256_setzero_ps(), _CMP_GT_OQ), value.v)};
+    }
+    float sum() const {
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        return _mm_cvtss_f32(half);
+    }
+};
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+struct FloatBatch {
+    static constexpr int WIDTH = 4;
+    __m128 v;
+
+    static FloatBatch load(const float* p) { return {_mm_loadu_ps(p)}; }
+    static FloatBatch broadcast(float x) { return {_mm_set1_ps(x)}; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    friend FloatBatch operator+(FloatBatch a, FloatBatch b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend FloatBatch operator-(FloatBatch a, FloatBatch b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend FloatBatch operator*(FloatBatch a, FloatBatch b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend FloatBatch operator/(FloatBatch a, FloatBatch b) { return {_mm_div_ps(a.v, b.v)}; }
+    friend FloatBatch sqrt(FloatBatch a) { return {_mm_sqrt_ps(a.v)}; }
+    friend FloatBatch fma(FloatBatch a, FloatBatch b, FloatBatch c) { return a * b + c; }
+    friend FloatBatch maskPositive(FloatBatch test, FloatBatch value) {
+        return {_mm_and_ps(_mm_cmpgt_ps(test.v, _mm_setzero_ps()), value.v)};
+    }
+    float sum() const {
+        __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        pairs = _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1));
+        return _mm_cvtss_f32(pairs);
+    }
+};
+
+#else
+
+#include <cmath>
+
+struct FloatBatch {
+    static constexpr int WIDTH = 1;
+    float v;
+
+    static FloatBatch load(const float* p) { return {*p}; }
+    static FloatBatch broadcast(float x) { return {x}; }
+    void store(float* p) const { *p = v; }
+    friend FloatBatch operator+(FloatBatch a, FloatBatch b) { return {a.v + b.v}; }
+    friend FloatBatch operator-(FloatBatch a, FloatBatch b) { return {a.v - b.v}; }
+    friend FloatBatch operator*(FloatBatch a, FloatBatch b) { return {a.v * b.v}; }
+    friend FloatBatch operator/(FloatBatch a, FloatBatch b) { return {a.v / b.v}; }
+    friend FloatBatch sqrt(FloatBatch a) { return {std::sqrt(a.v)}; }
+    friend FloatBatch fma(FloatBatch a, FloatBatch b, FloatBatch c) { return {a.v * b.v + c.v}; }
+    friend FloatBatch maskPositive(FloatBatch test, FloatBatch value) { return {test.v > 0.0f ? value.v : 0.0f}; }
+    float sum() const { return v; }
+};
+
+#endif
+
+#endif //SIMD_H
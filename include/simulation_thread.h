@@ -0,0 +1,60 @@
+//
+// Runs a CPU-backend ParticleSystem on its own thread in real time, so a slow step does not
+// hold up the display and waiting for vsync does not hold up the simulation. Every step is
+// published as a SimulationFrame through a TripleBuffer; the render thread takes the newest one
+// whenever it draws.
+//
+
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include <particle_system.h>
+#include <triple_buffer.h>
+
+struct SimulationFrame {
+    std::vector<glm::vec4> positions;
+    std::vector<glm::vec4> velocities;
+    // positions before the last step, for interpolating between the two
+    std::vector<glm::vec4> previousPositions;
+    uint64_t step = 0;
+    // when the last step finished; the renderer blends over the following step length
+    std::chrono::steady_clock::time_point publishTime;
+};
+
+class SimulationThread {
+    std::unique_ptr<ParticleSystem> particleSystem;
+    float stepSize;
+    int maxSubsteps;
+    TripleBuffer<SimulationFrame> frames;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> stepsTaken{0};
+    std::thread thread;
+
+    void run();
+    void publish(const std::vector<glm::vec4>& previousPositions);
+
+public:
+    // settings.backend is forced to CPU: the system must not touch the render thread's context.
+    // The initial state is published before the thread starts, so there is always a frame
+    explicit SimulationThread(ParticleSystemSettings settings, float stepSize, int maxSubsteps);
+    // stops after the step in progress
+    ~SimulationThread();
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // render thread only: the newest published frame, and whether it changed since the last call
+    bool acquireFrame() { return frames.acquire(); }
+    const SimulationFrame& frame() const { return frames.readBuffer(); }
+    float getStepSize() const { return stepSize; }
+    // steps completed so far; read from any thread to derive the simulation rate
+    uint64_t getStepCount() const { return stepsTaken.load(std::memory_order_relaxed); }
+};
+
+#endif //SIMULATION_THREAD_H
@@ -0,0 +1,78 @@
+//
+// Binary snapshot files for checkpoint/restart.
+//
+// Layout (little endian): a 64-byte SnapshotHeader, then chunkCount SnapshotChunk directory
+// entries, then the chunk payloads. Payloads start on 64-byte boundaries and are raw arrays in
+// the in-memory layout of ParticleState, so a memory-mapped file can be handed straight to
+// glBufferData / memcpy without any parsing:
+//   "POSM"  particleCount x vec4, xyz = position, w = mass
+//   "VELO"  particleCount x vec4, xyz = velocity, w unused
+//   "PIDS"  particleCount x uint32, particle ids (optional, identity when missing)
+// Readers skip chunk tags they do not know, so new chunks can be added without a version bump.
+//
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+#include <particle.h>
+
+const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];           // "NBODYSNP"
+    uint32_t version;
+    uint32_t chunkCount;
+    uint64_t particleCount;
+    uint64_t step;
+    double time;
+    uint8_t reserved[24];
+};
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout changed");
+
+struct SnapshotChunk {
+    char tag[4];
+    uint32_t elementSize;    // bytes per particle
+    uint64_t offset;         // from the start of the file
+    uint64_t size;           // bytes
+};
+static_assert(sizeof(SnapshotChunk) == 24, "snapshot chunk layout changed");
+
+// writes to path + ".tmp" and renames over path, so a crash mid-write never leaves a torn
+// checkpoint behind; returns false (after printing why) if the file could not be written
+bool writeSnapshot(const std::string& path, const ParticleState& state, uint64_t step, double time);
+
+// read-only memory mapping of a snapshot file; throws std::runtime_error if the file cannot be
+// mapped or is not a valid snapshot
+class MappedSnapshot {
+    const uint8_t* data = nullptr;
+    size_t fileSize = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+    const SnapshotHeader* header = nullptr;
+    const glm::vec4* positionData = nullptr;
+    const glm::vec4* velocityData = nullptr;
+    const uint32_t* idData = nullptr;
+
+    void release();
+
+public:
+    explicit MappedSnapshot(const std::string& path);
+    ~MappedSnapshot();
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    size_t particleCount() const { return (size_t)header->particleCount; }
+    uint64_t step() const { return header->step; }
+    double time() const { return header->time; }
+    const glm::vec4* positions() const { return positionData; }
+    const glm::vec4* velocities() const { return velocityData; }
+    // null for snapshots written without ids
+    const uint32_t* ids() const { return idData; }
+};
+
+#endif //SNAPSHOT_H
@@ -0,0 +1,86 @@
+//
+// Work-stealing task scheduler behind parallelFor. Every worker thread owns a deque: it pushes and
+// pops its own tasks at the back (newest first, which keeps its data warm) and, when that runs dry,
+// steals the oldest task from the front of another worker's deque. Threads outside the pool
+// (the main loop, a SimulationThread) share slot 0's deque, and every thread that waits for a task
+// runs other tasks meanwhile, so nested parallelFor calls and waits inside tasks cannot deadlock.
+//
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Task;
+using TaskHandle = std::shared_ptr<Task>;
+
+struct WorkerStats {
+    uint64_t tasks = 0;
+    // tasks this worker took from another worker's deque
+    uint64_t steals = 0;
+    double busySeconds = 0.0;
+    // busySeconds over the time since the stats were last reset
+    double utilization = 0.0;
+};
+
+class TaskScheduler {
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<TaskHandle> tasks;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> busyNanoseconds{0};
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    // tasks sitting in any deque; idle workers sleep on wakeup while it is zero
+    std::atomic<size_t> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> stopping{false};
+    std::atomic<int64_t> statsStart;
+
+    void workerLoop(size_t slot);
+    void push(const TaskHandle& task);
+    TaskHandle pop(size_t slot);
+    // runs one queued task if there is any, the calling thread's own deque first
+    bool runOne();
+    void run(size_t slot, const TaskHandle& task, bool stolen);
+
+public:
+    // one slot per worker; slot 0 is for threads outside the pool, so workers - 1 threads start
+    explicit TaskScheduler(unsigned int workers);
+    ~TaskScheduler();
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // the pool parallelFor runs on, workerCount() slots, started on first use
+    static TaskScheduler& instance();
+
+    // queues work to run once every task in dependencies has finished
+    TaskHandle submit(std::function<void()> work, const std::vector<TaskHandle>& dependencies = {});
+    // returns once the task has finished, running other tasks meanwhile
+    void wait(const TaskHandle& task);
+    void wait(const std::vector<TaskHandle>& tasks);
+
+    // splits [begin, end) into chunks of at least grain elements, a few per worker so stealing
+    // can even out uneven chunks, and returns once body has run on all of them. Ranges shorter
+    // than 2 * grain (too short for two chunks) run inline
+    void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t grain);
+
+    size_t workerSlots() const { return workers.size(); }
+    // per slot, since the last resetStats() (or the start)
+    std::vector<WorkerStats> workerStats() const;
+    void resetStats();
+};
+
+#endif //TASK_SCHEDULER_H
@@ -0,0 +1,109 @@
+//
+// Low-overhead event tracing. Events are small fixed-size records (a name pointer, a timestamp, a
+// value) pushed into a bounded lock-free ring (Vyukov's multi-producer queue: a compare-and-swap
+// and a sequence store per event, no allocation, no I/O). A background thread drains the ring into
+// a Chrome trace / Perfetto JSON file. When the ring is full, events are dropped and counted instead
+// of blocking the thread that emits them. Nothing is recorded unless a TraceRecorder is alive.
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct TraceEvent {
+    // only the pointer is stored, so names must outlive the recorder (string literals)
+    const char* name;
+    // steady clock nanoseconds
+    int64_t timestamp;
+    // counter value
+    double value;
+    uint32_t thread;
+    // 'B'/'E' begin/end of a scope, 'C' counter, 'i' instant, 'M' thread name (name is the thread's)
+    char phase;
+};
+
+class TraceRecorder {
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        TraceEvent event;
+    };
+
+    static std::atomic<TraceRecorder*> current;
+
+    std::unique_ptr<Slot[]> slots;
+    uint64_t mask;
+    alignas(64) std::atomic<uint64_t> head{0};
+    // only touched by the drain thread
+    alignas(64) uint64_t tail = 0;
+    std::atomic<uint64_t> dropped{0};
+
+    std::ofstream file;
+    bool firstEvent = true;
+    int64_t startTime;
+    std::thread drainThread;
+    std::mutex stopMutex;
+    std::condition_variable stopSignal;
+    bool stopping = false;
+
+    bool pop(TraceEvent& event);
+    void drain();
+    void write(const TraceEvent& event);
+
+public:
+    // opens path and starts draining into it, throws if it cannot be written; capacity is rounded
+    // up to a power of two. Becomes the active recorder, which has to outlive every thread tracing
+    explicit TraceRecorder(const std::string& path, size_t capacity = 1 << 16);
+    // drains what is left and closes the JSON
+    ~TraceRecorder();
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // the recorder the trace* functions feed, null while none is alive
+    static TraceRecorder* active() { return current.load(std::memory_order_acquire); }
+
+    void record(const char* name, char phase, double value = 0.0);
+    // events lost because the ring was full
+    uint64_t getDroppedEvents() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+inline void traceBegin(const char* name) {
+    if (TraceRecorder* recorder = TraceRecorder::active()) recorder->record(name, 'B');
+}
+
+inline void traceEnd(const char* name) {
+    if (TraceRecorder* recorder = TraceRecorder::active()) recorder->record(name, 'E');
+}
+
+inline void traceCounter(const char* name, double value) {
+    if (TraceRecorder* recorder = TraceRecorder::active()) recorder->record(name, 'C', value);
+}
+
+inline void traceInstant(const char* name) {
+    if (TraceRecorder* recorder = TraceRecorder::active()) recorder->record(name, 'i');
+}
+
+// labels the calling thread's track in the trace viewer
+inline void traceThreadName(const char* name) {
+    if (TraceRecorder* recorder = TraceRecorder::active()) recorder->record(name, 'M');
+}
+
+// traceBegin/traceEnd around a scope
+class TraceScope {
+    const char* name;
+
+public:
+    explicit TraceScope(const char* name) : name(name) { traceBegin(name); }
+    ~TraceScope() { traceEnd(name); }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif //TRACE_H
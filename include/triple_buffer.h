@@ -0,0 +1,52 @@
+//
+// Lock-free single-producer single-consumer handoff of the latest value. The writer fills its own
+// slot and publishes it by swapping it with the middle one; the reader swaps the middle slot for
+// its own only when something new was published. Neither side ever waits for the other, and the
+// reader always sees the most recent complete value (intermediate ones are skipped).
+//
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer {
+    static const uint32_t INDEX_MASK = 3;
+    // set in middle while its slot holds a value the reader has not taken yet
+    static const uint32_t FRESH_BIT = 4;
+
+    T slots[3];
+    // on its own cache line so the two threads' slot indices do not share it
+    alignas(64) std::atomic<uint32_t> middle{1};
+    alignas(64) uint32_t writeIndex = 0;
+    alignas(64) uint32_t readIndex = 2;
+
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // writer side: the slot to fill, owned by the writer until publish()
+    T& writeBuffer() { return slots[writeIndex]; }
+
+    // writer side: hands the filled slot over and takes the middle one (the reader's previous or
+    // an unread older value) to write into next
+    void publish() {
+        writeIndex = middle.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // reader side: makes the latest published value the read slot; false (and the read slot
+    // unchanged) if nothing was published since the last call
+    bool acquire() {
+        if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0) return false;
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // reader side: owned by the reader until the next acquire()
+    const T& readBuffer() const { return slots[readIndex]; }
+};
+
+#endif //TRIPLE_BUFFER_H
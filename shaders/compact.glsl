@@ -0,0 +1,30 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// Scatter step of GpuCompaction: offsets holds the exclusive scan of the flags, so every kept
+// value lands at its rank among the kept values.
+
+layout(std430, binding = 0) readonly buffer FlagBuffer {
+    uint flags[];
+};
+
+layout(std430, binding = 1) readonly buffer OffsetBuffer {
+    uint offsets[];
+};
+
+layout(std430, binding = 2) readonly buffer ValueBuffer {
+    uint values[];
+};
+
+layout(std430, binding = 3) writeonly buffer OutputBuffer {
+    uint outputValues[];
+};
+
+uniform uint count;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index < count && flags[index] != 0u) {
+        outputValues[offsets[index]] = values[index];
+    }
+}
@@ -1,53 +1,133 @@
 #version 430
 layout(local_size_x = 128) in;
 
-struct Particle {
-    vec4 position;
-    vec4 velocity;
-    float mass;
-    float padding[3];
+// ping-pong buffers: every invocation reads the previous state and writes the next one, so no
+// invocation can observe a position another one has already advanced this step.
+// Positions carry the mass in w so the force loop only reads one vec4 per body.
+layout(std430, binding = 0) readonly buffer PositionBufferIn {
+    vec4 positionsIn[];
 };
 
-layout(std430, binding = 0) buffer ParticleBuffer {
-    Particle particles[];
+layout(std430, binding = 1) readonly buffer VelocityBufferIn {
+    vec4 velocitiesIn[];
 };
 
+layout(std430, binding = 2) writeonly buffer PositionBufferOut {
+    vec4 positionsOut[];
+};
+
+layout(std430, binding = 3) writeonly buffer VelocityBufferOut {
+    vec4 velocitiesOut[];
+};
+
+// gravitational acceleration from the last force evaluation; each invocation only touches its
+// own entry, so this one does not need double buffering
+layout(std430, binding = 4) buffer AccelerationBuffer {
+    vec4 accelerations[];
+};
+
+// one integrator stage (see include/integrator.h): v += kick * dt * a, then x += drift * dt * v.
+// When evaluateForces is false the positions have not moved since the last evaluation and the
+// stored accelerations are reused.
 uniform float deltaTime;
+uniform float kickCoefficient;
+uniform float driftCoefficient;
+uniform bool evaluateForces;
+// Accumulation (include/force_solver.h): 0 adds every pair term to one fp32 total; 1 and 2 add
+// BLOCK_SIZE terms in fp32 and combine the block sums with Kahan compensation (1) or in double (2).
+// Either of those also keeps each drift's rounding error in residuals and adds it to the next drift.
+uniform int accumulation;
+#define BLOCK_SIZE 128
+
+// only bound when accumulation != 0; xyz per particle, each invocation touches its own entry
+layout(std430, binding = 5) buffer ResidualBuffer {
+    vec4 residuals[];
+};
+
 const float G = 6.67430e-11;
 //const float G = 0.0000000002;
 const float softening = 0.1;
 const float drag = 0.1;
 
+precise vec3 kahanSum = vec3(0.0);
+precise vec3 kahanCompensation = vec3(0.0);
+dvec3 doubleSum = dvec3(0.0);
+
+// precise keeps the compiler from reassociating the compensation away
+void addBlock(vec3 block) {
+    if (accumulation == 2) {
+        doubleSum += dvec3(block);
+    } else {
+        precise vec3 corrected = block - kahanCompensation;
+        precise vec3 next = kahanSum + corrected;
+        kahanCompensation = (next - kahanSum) - corrected;
+        kahanSum = next;
+    }
+}
+
+vec3 blockTotal() {
+    return accumulation == 2 ? vec3(doubleSum) : kahanSum;
+}
+
+// pos + delta with the rounding error of the sum (TwoSum) carried to the next drift
+vec3 drift(uint index, vec3 pos, vec3 delta) {
+    if (accumulation == 0) return pos + delta;
+    precise vec3 step = delta + residuals[index].xyz;
+    precise vec3 sum = pos + step;
+    precise vec3 stepPart = sum - pos;
+    precise vec3 error = (pos - (sum - stepPart)) + (step - stepPart);
+    residuals[index] = vec4(error, 0.0);
+    return sum;
+}
+
 void main() {
     uint index = gl_GlobalInvocationID.x;
-    if (index >= particles.length()) return;
+    uint count = positionsIn.length();
+    if (index >= count) return;
 
-    vec3 pos = particles[index].position.xyz;
-    vec3 vel = particles[index].velocity.xyz;
-    float mass = particles[index].mass;
+    vec4 self = positionsIn[index];
+    vec3 pos = self.xyz;
+    vec3 vel = velocitiesIn[index].xyz;
+    float mass = self.w;
 
-    vec3 dragForce = -drag *  vel;
+    vec3 gravity;
+    if (evaluateForces) {
+        vec3 totalForce = vec3(0.0);
 
-    vec3 totalForce = vec3(0.0);
+        for (uint blockStart = 0; blockStart < count; blockStart += BLOCK_SIZE) {
+            uint blockEnd = min(count, blockStart + BLOCK_SIZE);
+            for (uint i = blockStart; i < blockEnd; i++) {
+                if (i == index) continue;
 
-    for (uint i = 0; i < particles.length(); i++) {
-        if (i == index) continue;
+                vec4 other = positionsIn[i];
+                vec3 otherPos = other.xyz;
+                float otherMass = other.w;
 
-        vec3 otherPos = particles[i].position.xyz;
-        float otherMass = particles[i].mass;
+                vec3 dir = otherPos - pos;
+                float distSqr = dot(dir, dir) + softening;
 
-        vec3 dir = otherPos - pos;
-        float distSqr = dot(dir, dir) + softening;
+                totalForce += normalize(dir) * G * mass * otherMass / distSqr;
+            }
+            if (accumulation != 0) {
+                addBlock(totalForce);
+                totalForce = vec3(0.0);
+            }
+        }
+        if (accumulation != 0) {
+            totalForce = blockTotal();
+        }
 
-        totalForce += normalize(dir) * G * mass * otherMass / distSqr;
-        totalForce += dragForce;
+        gravity = totalForce / mass;
+        accelerations[index] = vec4(gravity, 0.0);
+    } else {
+        gravity = accelerations[index].xyz;
     }
 
+    // drag used to be added once per interaction inside the loop above
+    vec3 acc = gravity - drag * vel * float(count - 1) / mass;
+    vec3 newVel = vel + acc * (kickCoefficient * deltaTime);
+    vec3 newPos = drift(index, pos, newVel * (driftCoefficient * deltaTime));
 
-    vec3 acc = totalForce / mass;
-    vec3 newVel = vel + acc * deltaTime;
-    vec3 newPos = pos + newVel * deltaTime;
-
-    particles[index].velocity.xyz = newVel;
-    particles[index].position.xyz = newPos;
+    velocitiesOut[index] = vec4(newVel, velocitiesIn[index].w);
+    positionsOut[index] = vec4(newPos, mass);
 }
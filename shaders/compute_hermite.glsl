@@ -0,0 +1,101 @@
+#version 430
+layout(local_size_x = 128) in;
+
+// Fourth-order Hermite predictor-corrector with one shared step (see include/hermite.h), in
+// dispatches selected by stage:
+//   stage 0: predict every particle from the current buffers into the next ones
+//   stage 1: acceleration and jerk at the predicted state of everyone, then correct the current
+//            buffers in place (each invocation only touches its own entry there)
+//   stage 2: acceleration and jerk of the current state, read through the next-buffer bindings
+//            (ParticleSystem binds the current buffers there), to start the integration
+// ParticleSystem keeps the current buffers current, the next pair is only scratch for the
+// prediction.
+
+layout(std430, binding = 0) buffer PositionBuffer {
+    vec4 positions[];
+};
+
+layout(std430, binding = 1) buffer VelocityBuffer {
+    vec4 velocities[];
+};
+
+layout(std430, binding = 2) buffer PredictedPositionBuffer {
+    vec4 predictedPositions[];
+};
+
+layout(std430, binding = 3) buffer PredictedVelocityBuffer {
+    vec4 predictedVelocities[];
+};
+
+// both include the drag, whose derivative -k a joins the jerk
+layout(std430, binding = 4) buffer AccelerationBuffer {
+    vec4 accelerations[];
+};
+
+layout(std430, binding = 5) buffer JerkBuffer {
+    vec4 jerks[];
+};
+
+uniform float deltaTime;
+uniform int stage;
+const float G = 6.67430e-11;
+const float softening = 0.1;
+const float drag = 0.1;
+
+// pair term m d f(r) with f = 1 / (r (r^2 + s)) and its time derivative
+// m (v f - d (3 r^2 + s) f^2 (d . v) / r), summed over the predicted buffers
+void evaluate(uint index, out vec3 acc, out vec3 jerk) {
+    uint count = predictedPositions.length();
+    vec3 pos = predictedPositions[index].xyz;
+    vec3 vel = predictedVelocities[index].xyz;
+    acc = vec3(0.0);
+    jerk = vec3(0.0);
+    for (uint j = 0; j < count; j++) {
+        vec4 other = predictedPositions[j];
+        vec3 d = other.xyz - pos;
+        float distSqr = dot(d, d);
+        // r == 0 is the particle itself
+        if (distSqr == 0.0) continue;
+        vec3 v = predictedVelocities[j].xyz - vel;
+        float dist = sqrt(distSqr);
+        float f = 1.0 / (dist * (distSqr + softening));
+        float scale = other.w * f;
+        acc += d * scale;
+        jerk += v * scale - d * (scale * f * (3.0 * distSqr + softening) * dot(d, v) / dist);
+    }
+    acc *= G;
+    jerk *= G;
+
+    float dragScale = drag * float(count - 1) / predictedPositions[index].w;
+    acc -= vel * dragScale;
+    jerk -= acc * dragScale;
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= positions.length()) return;
+    float h = deltaTime;
+
+    if (stage == 0) {
+        vec3 acc = accelerations[index].xyz;
+        vec3 jerk = jerks[index].xyz;
+        vec3 vel = velocities[index].xyz;
+        predictedPositions[index] = vec4(positions[index].xyz + h * (vel + h * (acc * 0.5 + h * jerk / 6.0)), positions[index].w);
+        predictedVelocities[index] = vec4(vel + h * (acc + h * jerk * 0.5), velocities[index].w);
+        return;
+    }
+
+    vec3 a1, j1;
+    evaluate(index, a1, j1);
+    if (stage == 1) {
+        vec3 a0 = accelerations[index].xyz;
+        vec3 j0 = jerks[index].xyz;
+        vec3 snap = (-6.0 * (a0 - a1) - h * (4.0 * j0 + 2.0 * j1)) / (h * h);
+        vec3 crackle = (12.0 * (a0 - a1) + 6.0 * h * (j0 + j1)) / (h * h * h);
+        float h2 = h * h;
+        positions[index] = vec4(predictedPositions[index].xyz + h2 * h2 * (snap / 24.0 + h * crackle / 120.0), positions[index].w);
+        velocities[index] = vec4(predictedVelocities[index].xyz + h2 * h * (snap / 6.0 + h * crackle / 24.0), velocities[index].w);
+    }
+    accelerations[index] = vec4(a1, 0.0);
+    jerks[index] = vec4(j1, 0.0);
+}
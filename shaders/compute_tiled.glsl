@@ -0,0 +1,142 @@
+#version 430
+layout(local_size_x = 128) in;
+
+// Same physics as compute.glsl, but each workgroup cooperatively stages TILE_SIZE positions and
+// masses in shared memory and every invocation then runs over the tile, so each body is fetched
+// from global memory once per workgroup instead of once per invocation.
+#define TILE_SIZE 128
+
+layout(std430, binding = 0) readonly buffer PositionBufferIn {
+    vec4 positionsIn[];
+};
+
+layout(std430, binding = 1) readonly buffer VelocityBufferIn {
+    vec4 velocitiesIn[];
+};
+
+layout(std430, binding = 2) writeonly buffer PositionBufferOut {
+    vec4 positionsOut[];
+};
+
+layout(std430, binding = 3) writeonly buffer VelocityBufferOut {
+    vec4 velocitiesOut[];
+};
+
+layout(std430, binding = 4) buffer AccelerationBuffer {
+    vec4 accelerations[];
+};
+
+// integrator stage, see compute.glsl
+uniform float deltaTime;
+uniform float kickCoefficient;
+uniform float driftCoefficient;
+uniform bool evaluateForces;
+// the same modes as compute.glsl, with one tile as the block
+uniform int accumulation;
+
+layout(std430, binding = 5) buffer ResidualBuffer {
+    vec4 residuals[];
+};
+
+const float G = 6.67430e-11;
+const float softening = 0.1;
+const float drag = 0.1;
+
+// xyz = position, w = mass; slots past the end of the buffer hold zero mass
+shared vec4 tile[TILE_SIZE];
+
+precise vec3 kahanSum = vec3(0.0);
+precise vec3 kahanCompensation = vec3(0.0);
+dvec3 doubleSum = dvec3(0.0);
+
+// precise keeps the compiler from reassociating the compensation away
+void addBlock(vec3 block) {
+    if (accumulation == 2) {
+        doubleSum += dvec3(block);
+    } else {
+        precise vec3 corrected = block - kahanCompensation;
+        precise vec3 next = kahanSum + corrected;
+        kahanCompensation = (next - kahanSum) - corrected;
+        kahanSum = next;
+    }
+}
+
+vec3 blockTotal() {
+    return accumulation == 2 ? vec3(doubleSum) : kahanSum;
+}
+
+// pos + delta with the rounding error of the sum (TwoSum) carried to the next drift
+vec3 drift(uint index, vec3 pos, vec3 delta) {
+    if (accumulation == 0) return pos + delta;
+    precise vec3 step = delta + residuals[index].xyz;
+    precise vec3 sum = pos + step;
+    precise vec3 stepPart = sum - pos;
+    precise vec3 error = (pos - (sum - stepPart)) + (step - stepPart);
+    residuals[index] = vec4(error, 0.0);
+    return sum;
+}
+
+// normalize(dir) * otherMass / (r^2 + softening); r == 0 is the particle itself
+#define INTERACT(k) { \
+    vec3 dir = tile[k].xyz - pos; \
+    float distSqr = dot(dir, dir); \
+    float invDist = distSqr > 0.0 ? inversesqrt(distSqr) : 0.0; \
+    acc += dir * (tile[k].w * invDist / (distSqr + softening)); \
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    uint count = positionsIn.length();
+    // out-of-range invocations still have to help load tiles and reach every barrier()
+    bool inRange = index < count;
+
+    vec4 self = inRange ? positionsIn[index] : vec4(0.0);
+    vec3 pos = self.xyz;
+
+    vec3 gravity = vec3(0.0);
+    // evaluateForces is uniform, so every invocation still reaches the same barriers
+    if (evaluateForces) {
+        vec3 acc = vec3(0.0);
+        for (uint tileStart = 0; tileStart < count; tileStart += TILE_SIZE) {
+            uint j = tileStart + gl_LocalInvocationID.x;
+            tile[gl_LocalInvocationID.x] = j < count ? positionsIn[j] : vec4(0.0);
+            barrier();
+
+            for (uint k = 0; k < TILE_SIZE; k += 4) {
+                INTERACT(k)
+                INTERACT(k + 1)
+                INTERACT(k + 2)
+                INTERACT(k + 3)
+            }
+            barrier();
+            if (accumulation != 0) {
+                addBlock(acc);
+                acc = vec3(0.0);
+            }
+        }
+        if (accumulation != 0) {
+            acc = blockTotal();
+        }
+        gravity = G * acc;
+        if (inRange) {
+            accelerations[index] = vec4(gravity, 0.0);
+        }
+    } else if (inRange) {
+        gravity = accelerations[index].xyz;
+    }
+
+    if (!inRange) return;
+
+    vec4 velocity = velocitiesIn[index];
+    vec3 vel = velocity.xyz;
+    float mass = self.w;
+
+    // compute.glsl originally added the drag force once per interaction
+    vec3 totalAcc = gravity - drag * vel * float(count - 1) / mass;
+
+    vec3 newVel = vel + totalAcc * (kickCoefficient * deltaTime);
+    vec3 newPos = drift(index, pos, newVel * (driftCoefficient * deltaTime));
+
+    velocitiesOut[index] = vec4(newVel, velocity.w);
+    positionsOut[index] = vec4(newPos, mass);
+}
@@ -0,0 +1,128 @@
+#version 430
+layout(local_size_x = 128) in;
+
+// Same integration as compute.glsl, with the gravity from a Barnes-Hut walk of the linear BVH
+// built by GpuTree (shaders/lbvh_build.glsl) instead of the all-pairs loop. A node is taken as a
+// point mass when (2 * reach / distance to its centre of mass) < theta, where reach is the distance
+// from the centre of mass to the farthest corner of the node's bounding box. The BVH boxes are
+// tight and often elongated, and the centre of mass can sit anywhere in them, so the largest side
+// the octree in barnes_hut.cpp uses would accept far more lopsided nodes here; with the reach, the
+// same theta gives about the octree's accuracy. Invocations take the particles in Morton order,
+// so neighbouring invocations walk nearly the same nodes.
+#define INVALID 0xffffffffu
+#define STACK_SIZE 64
+
+struct TreeNode {
+    vec4 centerOfMass;  // w = mass
+    vec4 lower;
+    vec4 upper;
+    uvec4 links;        // left child, right child, parent
+};
+
+layout(std430, binding = 0) readonly buffer PositionBufferIn {
+    vec4 positionsIn[];
+};
+
+layout(std430, binding = 1) readonly buffer VelocityBufferIn {
+    vec4 velocitiesIn[];
+};
+
+layout(std430, binding = 2) writeonly buffer PositionBufferOut {
+    vec4 positionsOut[];
+};
+
+layout(std430, binding = 3) writeonly buffer VelocityBufferOut {
+    vec4 velocitiesOut[];
+};
+
+layout(std430, binding = 4) buffer AccelerationBuffer {
+    vec4 accelerations[];
+};
+
+layout(std430, binding = 5) readonly buffer NodeBuffer {
+    TreeNode nodes[];
+};
+
+layout(std430, binding = 6) readonly buffer OrderBuffer {
+    uint order[];
+};
+
+// walks that ran out of stack, see GpuTree::readStackOverflows
+layout(std430, binding = 7) buffer OverflowBuffer {
+    uint stackOverflows;
+};
+
+// integrator stage, see compute.glsl
+uniform float deltaTime;
+uniform float kickCoefficient;
+uniform float driftCoefficient;
+uniform bool evaluateForces;
+uniform float theta;
+const float G = 6.67430e-11;
+const float softening = 0.1;
+const float drag = 0.1;
+
+vec3 treeAcceleration(vec3 pos, uint count) {
+    uint leafStart = count - 1u;
+    float thetaSqr = theta * theta;
+    vec3 acc = vec3(0.0);
+
+    uint stack[STACK_SIZE];
+    int stackSize = 0;
+    bool overflowed = false;
+    stack[stackSize++] = 0u;
+    while (stackSize > 0) {
+        uint n = stack[--stackSize];
+        vec4 centerOfMass = nodes[n].centerOfMass;
+        vec3 dir = centerOfMass.xyz - pos;
+        float distSqr = dot(dir, dir);
+
+        bool accept = n >= leafStart;
+        if (!accept) {
+            vec3 reach = max(nodes[n].upper.xyz - centerOfMass.xyz, centerOfMass.xyz - nodes[n].lower.xyz);
+            accept = 4.0 * dot(reach, reach) < thetaSqr * distSqr;
+            // a full stack falls back to the monopole rather than dropping the node, and is counted
+            if (!accept && stackSize + 2 > STACK_SIZE) {
+                accept = true;
+                overflowed = true;
+            }
+        }
+        if (accept) {
+            // r == 0 is the particle itself
+            float invDist = distSqr > 0.0 ? inversesqrt(distSqr) : 0.0;
+            acc += dir * (centerOfMass.w * invDist / (distSqr + softening));
+        } else {
+            stack[stackSize++] = nodes[n].links.x;
+            stack[stackSize++] = nodes[n].links.y;
+        }
+    }
+    if (overflowed) atomicAdd(stackOverflows, 1u);
+    return G * acc;
+}
+
+void main() {
+    uint count = positionsIn.length();
+    if (gl_GlobalInvocationID.x >= count) return;
+    uint index = order[gl_GlobalInvocationID.x];
+
+    vec4 self = positionsIn[index];
+    vec3 pos = self.xyz;
+    vec3 vel = velocitiesIn[index].xyz;
+    float mass = self.w;
+
+    vec3 gravity;
+    if (evaluateForces) {
+        gravity = treeAcceleration(pos, count);
+        accelerations[index] = vec4(gravity, 0.0);
+    } else {
+        gravity = accelerations[index].xyz;
+    }
+
+    // drag used to be added once per interaction, see compute.glsl
+    vec3 acc = gravity - drag * vel * float(count - 1) / mass;
+    vec3 newVel = vel + acc * (kickCoefficient * deltaTime);
+    vec3 newPos = pos + newVel * (driftCoefficient * deltaTime);
+
+    velocitiesOut[index] = vec4(newVel, velocitiesIn[index].w);
+    positionsOut[index] = vec4(newPos, mass);
+}
@@ -0,0 +1,30 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// outputValues[i] = inputValues[order[i]] for elements of wordsPerElement uints each, so one
+// program permutes vec4 and uint arrays alike
+
+layout(std430, binding = 0) readonly buffer OrderBuffer {
+    uint order[];
+};
+
+layout(std430, binding = 1) readonly buffer InputBuffer {
+    uint inputValues[];
+};
+
+layout(std430, binding = 2) writeonly buffer OutputBuffer {
+    uint outputValues[];
+};
+
+uniform uint count;
+uniform uint wordsPerElement;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= count) return;
+    uint source = order[index] * wordsPerElement;
+    uint target = index * wordsPerElement;
+    for (uint word = 0u; word < wordsPerElement; word++) {
+        outputValues[target + word] = inputValues[source + word];
+    }
+}
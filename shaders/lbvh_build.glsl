@@ -0,0 +1,131 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// Karras (2012) linear BVH over particles sorted by Morton key, in three dispatches selected by
+// stage. Nodes 0 .. count - 2 are internal (0 is the root), count - 1 + k is the leaf of the k-th
+// particle in key order; with one particle the root is that leaf.
+//   stage 0, one invocation per particle: leaves from the sorted positions, internal nodes and
+//            their arrival counters reset
+//   stage 1, one invocation per internal node: its key range and split, hence both children
+//   stage 2, one invocation per leaf: walks up the tree, the second child to arrive at a node
+//            computes its mass, centre of mass and bounding box, so every node is reduced once
+#define INVALID 0xffffffffu
+
+struct TreeNode {
+    vec4 centerOfMass;  // w = mass
+    vec4 lower;
+    vec4 upper;
+    uvec4 links;        // left child, right child, parent
+};
+
+layout(std430, binding = 0) readonly buffer PositionBuffer {
+    vec4 positions[];
+};
+
+// 63-bit Morton keys as (low, high) pairs, already sorted
+layout(std430, binding = 1) readonly buffer KeyBuffer {
+    uvec2 keys[];
+};
+
+// order[k] = index of the particle with the k-th smallest key
+layout(std430, binding = 2) readonly buffer OrderBuffer {
+    uint order[];
+};
+
+layout(std430, binding = 3) coherent buffer NodeBuffer {
+    TreeNode nodes[];
+};
+
+layout(std430, binding = 4) coherent buffer CounterBuffer {
+    uint arrivals[];
+};
+
+uniform uint count;
+uniform int stage;
+
+int countLeadingZeros(uint value) {
+    return 31 - findMSB(value);
+}
+
+// length of the common key prefix of sorted slots i and j, -1 outside the array; equal keys
+// are told apart by their slot so every split is well defined
+int commonPrefix(int i, int j) {
+    if (j < 0 || j >= int(count)) return -1;
+    uvec2 a = keys[i];
+    uvec2 b = keys[j];
+    if (a.y != b.y) return countLeadingZeros(a.y ^ b.y);
+    if (a.x != b.x) return 32 + countLeadingZeros(a.x ^ b.x);
+    return 64 + countLeadingZeros(uint(i) ^ uint(j));
+}
+
+void buildNode(int i) {
+    int direction = commonPrefix(i, i + 1) > commonPrefix(i, i - 1) ? 1 : -1;
+    int minPrefix = commonPrefix(i, i - direction);
+
+    // exponential then binary search for the other end of the range
+    int maxLength = 2;
+    while (commonPrefix(i, i + maxLength * direction) > minPrefix) maxLength *= 2;
+    int length = 0;
+    for (int step = maxLength / 2; step >= 1; step /= 2) {
+        if (commonPrefix(i, i + (length + step) * direction) > minPrefix) length += step;
+    }
+    int j = i + length * direction;
+
+    // binary search for the last slot sharing more than the range's common prefix
+    int nodePrefix = commonPrefix(i, j);
+    int split = 0;
+    int step = length;
+    do {
+        step = (step + 1) >> 1;
+        if (commonPrefix(i, i + (split + step) * direction) > nodePrefix) split += step;
+    } while (step > 1);
+    int gamma = i + split * direction + min(direction, 0);
+
+    uint leafStart = count - 1u;
+    uint left = min(i, j) == gamma ? leafStart + uint(gamma) : uint(gamma);
+    uint right = max(i, j) == gamma + 1 ? leafStart + uint(gamma) + 1u : uint(gamma) + 1u;
+    nodes[i].links.x = left;
+    nodes[i].links.y = right;
+    nodes[left].links.z = uint(i);
+    nodes[right].links.z = uint(i);
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    uint leafStart = count - 1u;
+
+    if (stage == 0) {
+        if (index >= count) return;
+        vec4 p = positions[order[index]];
+        nodes[leafStart + index].centerOfMass = p;
+        nodes[leafStart + index].lower = vec4(p.xyz, 0.0);
+        nodes[leafStart + index].upper = vec4(p.xyz, 0.0);
+        nodes[leafStart + index].links = uvec4(INVALID);
+        if (index < leafStart) {
+            nodes[index].links = uvec4(INVALID);
+            arrivals[index] = 0u;
+        }
+    } else if (stage == 1) {
+        if (index >= leafStart) return;
+        buildNode(int(index));
+    } else {
+        if (index >= count) return;
+        uint node = nodes[leafStart + index].links.z;
+        while (node != INVALID) {
+            // publishes this subtree before the counter tells the sibling it is complete
+            memoryBarrierBuffer();
+            if (atomicAdd(arrivals[node], 1u) == 0u) return;
+
+            TreeNode left = nodes[nodes[node].links.x];
+            TreeNode right = nodes[nodes[node].links.y];
+            float mass = left.centerOfMass.w + right.centerOfMass.w;
+            vec3 center = mass > 0.0
+                ? (left.centerOfMass.xyz * left.centerOfMass.w + right.centerOfMass.xyz * right.centerOfMass.w) / mass
+                : 0.5 * (left.centerOfMass.xyz + right.centerOfMass.xyz);
+            nodes[node].centerOfMass = vec4(center, mass);
+            nodes[node].lower = min(left.lower, right.lower);
+            nodes[node].upper = max(left.upper, right.upper);
+            node = nodes[node].links.z;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// GPU version of computeMortonKeys (include/morton.h) in two dispatches: stage 0 reduces the
+// bounding box into bounds, stage 1 writes the 63-bit keys as (low, high) word pairs together
+// with each particle's index, ready for GpuRadixSort.
+
+layout(std430, binding = 0) readonly buffer PositionBuffer {
+    vec4 positions[];
+};
+
+// lower xyz then upper xyz, as order-preserving uints so atomicMin/atomicMax work on floats
+layout(std430, binding = 1) buffer BoundsBuffer {
+    uint bounds[6];
+};
+
+layout(std430, binding = 2) writeonly buffer KeyBuffer {
+    uint keys[];
+};
+
+layout(std430, binding = 3) writeonly buffer IndexBuffer {
+    uint indices[];
+};
+
+uniform uint count;
+uniform int stage;
+
+shared vec3 lowerPartial[256];
+shared vec3 upperPartial[256];
+
+uint orderedBits(float value) {
+    uint bits = floatBitsToUint(value);
+    return (bits & 0x80000000u) != 0u ? ~bits : bits | 0x80000000u;
+}
+
+float orderedFloat(uint bits) {
+    return uintBitsToFloat((bits & 0x80000000u) != 0u ? bits & 0x7fffffffu : ~bits);
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    uint local = gl_LocalInvocationID.x;
+
+    if (stage == 0) {
+        vec3 pos = positions[min(index, count - 1u)].xyz;
+        lowerPartial[local] = pos;
+        upperPartial[local] = pos;
+        for (uint width = 128u; width > 0u; width >>= 1u) {
+            barrier();
+            if (local < width) {
+                lowerPartial[local] = min(lowerPartial[local], lowerPartial[local + width]);
+                upperPartial[local] = max(upperPartial[local], upperPartial[local + width]);
+            }
+        }
+        if (local == 0u) {
+            for (int axis = 0; axis < 3; axis++) {
+                atomicMin(bounds[axis], orderedBits(lowerPartial[0][axis]));
+                atomicMax(bounds[3 + axis], orderedBits(upperPartial[0][axis]));
+            }
+        }
+        return;
+    }
+
+    if (index >= count) return;
+    vec3 lower = vec3(orderedFloat(bounds[0]), orderedFloat(bounds[1]), orderedFloat(bounds[2]));
+    vec3 upper = vec3(orderedFloat(bounds[3]), orderedFloat(bounds[4]), orderedFloat(bounds[5]));
+    vec3 size = upper - lower;
+    float extent = max(1e-6, max(size.x, max(size.y, size.z)));
+    uvec3 cell = min(uvec3((positions[index].xyz - lower) * (float((1 << 21) - 1) / extent)), uvec3((1u << 21) - 1u));
+
+    // bit i of each axis goes to bit 3i + axis of the key
+    uvec2 key = uvec2(0u);
+    for (uint bit = 0u; bit < 21u; bit++) {
+        for (uint axis = 0u; axis < 3u; axis++) {
+            uint target = 3u * bit + axis;
+            uint value = (cell[axis] >> bit) & 1u;
+            if (target < 32u) key.x |= value << target;
+            else key.y |= value << (target - 32u);
+        }
+    }
+    keys[2u * index] = key.x;
+    keys[2u * index + 1u] = key.y;
+    indices[index] = index;
+}
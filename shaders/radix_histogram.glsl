@@ -0,0 +1,40 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// First step of a GpuRadixSort pass: how many keys of this workgroup's block have each 4-bit
+// digit. Counts are stored digit-major (digit * groupCount + group) so that their exclusive scan
+// gives every (digit, block) pair its first output slot.
+#define RADIX 16u
+
+layout(std430, binding = 0) readonly buffer KeyBuffer {
+    uint keys[];
+};
+
+layout(std430, binding = 1) writeonly buffer CountBuffer {
+    uint blockCounts[];
+};
+
+uniform uint count;
+// 1 for 32-bit keys, 2 for 64-bit keys stored as (low, high) word pairs
+uniform uint keyWords;
+// bit offset of the digit within the whole key
+uniform uint shift;
+
+shared uint digitCounts[RADIX];
+
+void main() {
+    uint local = gl_LocalInvocationID.x;
+    if (local < RADIX) digitCounts[local] = 0u;
+    barrier();
+
+    uint index = gl_GlobalInvocationID.x;
+    if (index < count) {
+        uint word = keys[index * keyWords + shift / 32u];
+        atomicAdd(digitCounts[(word >> (shift % 32u)) & (RADIX - 1u)], 1u);
+    }
+    barrier();
+
+    if (local < RADIX) {
+        blockCounts[local * gl_NumWorkGroups.x + gl_WorkGroupID.x] = digitCounts[local];
+    }
+}
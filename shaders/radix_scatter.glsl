@@ -0,0 +1,77 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// Second step of a GpuRadixSort pass: every key goes to the first global slot of its (digit,
+// block) pair from the scanned counts plus the number of keys before it in the block with the same
+// digit. Those ranks come from one shared-memory scan of one-hot digit counters, packed as 16
+// 8-bit lanes in a uvec4; scanning the previous element's counter keeps the scan exclusive, so no
+// lane ever exceeds 255.
+#define BLOCK_SIZE 256u
+#define RADIX 16u
+
+layout(std430, binding = 0) readonly buffer KeyBufferIn {
+    uint keysIn[];
+};
+
+layout(std430, binding = 1) readonly buffer ValueBufferIn {
+    uint valuesIn[];
+};
+
+layout(std430, binding = 2) writeonly buffer KeyBufferOut {
+    uint keysOut[];
+};
+
+layout(std430, binding = 3) writeonly buffer ValueBufferOut {
+    uint valuesOut[];
+};
+
+layout(std430, binding = 4) readonly buffer OffsetBuffer {
+    uint digitOffsets[];
+};
+
+uniform uint count;
+uniform uint keyWords;
+uniform uint shift;
+
+shared uint digits[BLOCK_SIZE];
+shared uvec4 counters[BLOCK_SIZE];
+
+uvec4 oneHot(uint digit) {
+    uvec4 counter = uvec4(0u);
+    counter[digit / 4u] = 1u << (8u * (digit % 4u));
+    return counter;
+}
+
+void main() {
+    uint local = gl_LocalInvocationID.x;
+    uint index = gl_GlobalInvocationID.x;
+    bool valid = index < count;
+
+    uvec2 key = uvec2(0u);
+    uint digit = RADIX;
+    if (valid) {
+        key.x = keysIn[index * keyWords];
+        key.y = keyWords == 2u ? keysIn[index * keyWords + 1u] : 0u;
+        digit = (shift < 32u ? key.x >> shift : key.y >> (shift - 32u)) & (RADIX - 1u);
+    }
+    digits[local] = digit;
+    barrier();
+
+    // out-of-range slots only ever trail the block, they contribute nothing
+    uint previous = local > 0u ? digits[local - 1u] : RADIX;
+    counters[local] = previous < RADIX ? oneHot(previous) : uvec4(0u);
+    barrier();
+    for (uint offset = 1u; offset < BLOCK_SIZE; offset <<= 1u) {
+        uvec4 add = local >= offset ? counters[local - offset] : uvec4(0u);
+        barrier();
+        counters[local] += add;
+        barrier();
+    }
+    if (!valid) return;
+
+    uint rank = (counters[local][digit / 4u] >> (8u * (digit % 4u))) & 0xffu;
+    uint slot = digitOffsets[digit * gl_NumWorkGroups.x + gl_WorkGroupID.x] + rank;
+    keysOut[slot * keyWords] = key.x;
+    if (keyWords == 2u) keysOut[slot * keyWords + 1u] = key.y;
+    valuesOut[slot] = valuesIn[index];
+}
@@ -0,0 +1,65 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// First half of GpuScan: exclusive prefix sum of each 512-element block (two per invocation) into
+// output, plus each block's total into blockSums. scan_add.glsl then adds the scanned block totals.
+// input and output may be the same buffer.
+#define BLOCK_SIZE 512
+
+layout(std430, binding = 0) readonly buffer InputBuffer {
+    uint inputValues[];
+};
+
+layout(std430, binding = 1) writeonly buffer OutputBuffer {
+    uint outputValues[];
+};
+
+layout(std430, binding = 2) writeonly buffer BlockSumBuffer {
+    uint blockSums[];
+};
+
+uniform uint count;
+
+shared uint partial[BLOCK_SIZE];
+
+void main() {
+    uint local = gl_LocalInvocationID.x;
+    uint blockStart = gl_WorkGroupID.x * BLOCK_SIZE;
+    uint first = blockStart + 2u * local;
+    partial[2u * local] = first < count ? inputValues[first] : 0u;
+    partial[2u * local + 1u] = first + 1u < count ? inputValues[first + 1u] : 0u;
+
+    // Blelloch up-sweep
+    uint offset = 1u;
+    for (uint width = BLOCK_SIZE / 2u; width > 0u; width >>= 1u) {
+        barrier();
+        if (local < width) {
+            uint left = offset * (2u * local + 1u) - 1u;
+            uint right = offset * (2u * local + 2u) - 1u;
+            partial[right] += partial[left];
+        }
+        offset <<= 1u;
+    }
+
+    if (local == 0u) {
+        blockSums[gl_WorkGroupID.x] = partial[BLOCK_SIZE - 1u];
+        partial[BLOCK_SIZE - 1u] = 0u;
+    }
+
+    // down-sweep
+    for (uint width = 1u; width < BLOCK_SIZE; width <<= 1u) {
+        offset >>= 1u;
+        barrier();
+        if (local < width) {
+            uint left = offset * (2u * local + 1u) - 1u;
+            uint right = offset * (2u * local + 2u) - 1u;
+            uint carry = partial[left];
+            partial[left] = partial[right];
+            partial[right] += carry;
+        }
+    }
+    barrier();
+
+    if (first < count) outputValues[first] = partial[2u * local];
+    if (first + 1u < count) outputValues[first + 1u] = partial[2u * local + 1u];
+}
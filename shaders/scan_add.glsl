@@ -0,0 +1,22 @@
+#version 430
+layout(local_size_x = 256) in;
+
+// Second half of GpuScan: adds the exclusive scan of the block totals to every element of the block.
+#define BLOCK_SIZE 512
+
+layout(std430, binding = 1) buffer OutputBuffer {
+    uint outputValues[];
+};
+
+layout(std430, binding = 2) readonly buffer BlockOffsetBuffer {
+    uint blockOffsets[];
+};
+
+uniform uint count;
+
+void main() {
+    uint offset = blockOffsets[gl_WorkGroupID.x];
+    uint first = gl_WorkGroupID.x * BLOCK_SIZE + gl_LocalInvocationID.x;
+    if (first < count) outputValues[first] += offset;
+    if (first + 256u < count) outputValues[first + 256u] += offset;
+}
@@ -1,25 +1,22 @@
 #version 430
 
-struct Particle {
-    vec4 position;
-    vec4 velocity;
-    float mass;
-    float padding[3];
-};
-
-layout(std430, binding = 0) buffer ParticleBuffer {
-    Particle particles[];
-};
+// fed from whichever position/velocity buffers hold the current state, see ParticleSystem::render
+layout(location = 0) in vec4 particlePosition; // w = mass
+layout(location = 1) in vec4 particleVelocity;
+// position before the last simulation step
+layout(location = 2) in vec4 previousParticlePosition;
 
 out vec4 velocity;
 
 //uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// how far the render time is between the previous and the current simulation step
+uniform float interpolationAlpha;
 
 void main() {
-    vec4 pos = particles[gl_VertexID].position;
-    gl_Position = projection * view * pos;
-    gl_PointSize = particles[gl_VertexID].mass / 100000.0f + 1.0f;
-    velocity = particles[gl_VertexID].velocity;
+    vec3 position = mix(previousParticlePosition.xyz, particlePosition.xyz, interpolationAlpha);
+    gl_Position = projection * view * vec4(position, 1.0);
+    gl_PointSize = particlePosition.w / 100000.0f + 1.0f;
+    velocity = particleVelocity;
 }
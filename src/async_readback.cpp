@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <async_readback.h>
+
+AsyncReadback::AsyncReadback(size_t slotCount) : slots(std::max<size_t>(2, slotCount)), persistent(GLAD_GL_VERSION_4_4 != 0) {}
+
+AsyncReadback::~AsyncReadback() {
+    for (Slot& slot : slots) {
+        if (slot.fence != nullptr) glDeleteSync(slot.fence);
+        if (slot.mapped != nullptr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+// immutable storage cannot be resized, so every slot is recreated; only happens when the request
+// grows, and waits for the copies in flight first
+void AsyncReadback::allocate(size_t bytes) {
+    for (Slot& slot : slots) {
+        if (slot.fence != nullptr) {
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        if (slot.mapped != nullptr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            slot.mapped = nullptr;
+        }
+        glDeleteBuffers(1, &slot.buffer);
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+        if (persistent) {
+            const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+            slot.mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, flags);
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        }
+    }
+    capacity = bytes;
+    oldest = 0;
+    inFlight = 0;
+}
+
+void AsyncReadback::land(Slot& slot) {
+    double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - slot.requestTime).count();
+    stats.landed++;
+    stats.totalLatencySeconds += latency;
+    stats.maxLatencySeconds = std::max(stats.maxLatencySeconds, latency);
+    stats.totalLatencyPolls += polls - slot.requestPoll;
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+}
+
+void AsyncReadback::request(const std::vector<ReadbackRange>& ranges, uint64_t tag) {
+    size_t bytes = 0;
+    for (const ReadbackRange& range : ranges) bytes += range.bytes;
+    if (bytes > capacity) allocate(bytes);
+
+    if (inFlight == slots.size()) {
+        // the GPU is a whole ring behind: wait for the oldest copy, which nobody will read now
+        Slot& slot = slots[oldest];
+        auto start = std::chrono::steady_clock::now();
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        stats.stalls++;
+        stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        land(slot);
+        oldest = (oldest + 1) % slots.size();
+        inFlight--;
+    }
+
+    Slot& slot = slots[(oldest + inFlight) % slots.size()];
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+    size_t offset = 0;
+    for (const ReadbackRange& range : ranges) {
+        glBindBuffer(GL_COPY_READ_BUFFER, range.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range.offset, offset, range.bytes);
+        offset += range.bytes;
+    }
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.tag = tag;
+    slot.requestTime = std::chrono::steady_clock::now();
+    slot.requestPoll = polls;
+    inFlight++;
+    stats.requests++;
+}
+
+const void* AsyncReadback::poll(uint64_t& tag) {
+    Slot* newest = nullptr;
+    // fences signal in submission order, so the first one still pending ends the scan
+    while (inFlight > 0) {
+        Slot& slot = slots[oldest];
+        GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        land(slot);
+        newest = &slot;
+        oldest = (oldest + 1) % slots.size();
+        inFlight--;
+    }
+    polls++;
+    if (newest == nullptr) return nullptr;
+
+    stats.delivered++;
+    tag = newest->tag;
+    if (persistent) return newest->mapped;
+    hostCopy.resize(capacity);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newest->buffer);
+    glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, capacity, hostCopy.data());
+    return hostCopy.data();
+}
@@ -0,0 +1,170 @@
+#include <cmath>
+#include <algorithm>
+#include <barnes_hut.h>
+#include <parallel.h>
+#include <physics.h>
+
+// coincident particles would otherwise subdivide forever
+static const int MAX_TREE_DEPTH = 32;
+
+BarnesHutSolver::BarnesHutSolver(float theta, int leafCapacity) : theta(theta), leafCapacity(std::max(1, leafCapacity)) {}
+
+void BarnesHutSolver::buildTree(const std::vector<glm::vec4>& positions) {
+    nodes.clear();
+    particleIndices.resize(positions.size());
+    scratchIndices.resize(positions.size());
+    for (uint32_t i = 0; i < positions.size(); i++) {
+        particleIndices[i] = i;
+    }
+
+    glm::vec3 lower(INFINITY), upper(-INFINITY);
+    for (const glm::vec4& p : positions) {
+        lower = glm::min(lower, glm::vec3(p));
+        upper = glm::max(upper, glm::vec3(p));
+    }
+    if (positions.empty()) {
+        lower = upper = glm::vec3(0.0f);
+    }
+
+    OctreeNode root{};
+    root.center = (lower + upper) * 0.5f;
+    // pad slightly so particles on the upper faces still land strictly inside the root cell
+    root.halfSize = std::max(1e-6f, std::max(upper.x - lower.x, std::max(upper.y - lower.y, upper.z - lower.z)) * 0.5f * 1.0001f);
+    root.firstChild = -1;
+    root.firstParticle = 0;
+    root.particleCount = (int)positions.size();
+    nodes.push_back(root);
+    subdivide(0, positions, 0);
+}
+
+void BarnesHutSolver::subdivide(int nodeIndex, const std::vector<glm::vec4>& positions, int depth) {
+    OctreeNode node = nodes[nodeIndex];
+    uint32_t* indices = particleIndices.data() + node.firstParticle;
+
+    if (node.particleCount <= leafCapacity || depth >= MAX_TREE_DEPTH) {
+        glm::vec3 weightedPosition(0.0f);
+        float mass = 0.0f;
+        for (int i = 0; i < node.particleCount; i++) {
+            const glm::vec4& p = positions[indices[i]];
+            weightedPosition += glm::vec3(p) * p.w;
+            mass += p.w;
+        }
+        nodes[nodeIndex].mass = mass;
+        nodes[nodeIndex].centerOfMass = mass > 0.0f ? weightedPosition / mass : node.center;
+        return;
+    }
+
+    // bucket this node's index range by octant (counting sort, stable)
+    auto octantOf = [&](uint32_t index) {
+        glm::vec3 p(positions[index]);
+        return (p.x > node.center.x ? 1 : 0) | (p.y > node.center.y ? 2 : 0) | (p.z > node.center.z ? 4 : 0);
+    };
+    int counts[8] = {};
+    for (int i = 0; i < node.particleCount; i++) {
+        counts[octantOf(indices[i])]++;
+    }
+    int offsets[8];
+    offsets[0] = 0;
+    for (int octant = 1; octant < 8; octant++) {
+        offsets[octant] = offsets[octant - 1] + counts[octant - 1];
+    }
+    uint32_t* sorted = scratchIndices.data() + node.firstParticle;
+    int cursor[8];
+    std::copy(offsets, offsets + 8, cursor);
+    for (int i = 0; i < node.particleCount; i++) {
+        sorted[cursor[octantOf(indices[i])]++] = indices[i];
+    }
+    std::copy(sorted, sorted + node.particleCount, indices);
+
+    int firstChild = (int)nodes.size();
+    nodes[nodeIndex].firstChild = firstChild;
+    float childHalfSize = node.halfSize * 0.5f;
+    for (int octant = 0; octant < 8; octant++) {
+        OctreeNode child{};
+        child.center = node.center + glm::vec3(
+            (octant & 1) ? childHalfSize : -childHalfSize,
+            (octant & 2) ? childHalfSize : -childHalfSize,
+            (octant & 4) ? childHalfSize : -childHalfSize);
+        child.halfSize = childHalfSize;
+        child.firstChild = -1;
+        child.firstParticle = node.firstParticle + offsets[octant];
+        child.particleCount = counts[octant];
+        nodes.push_back(child);
+    }
+
+    glm::vec3 weightedPosition(0.0f);
+    float mass = 0.0f;
+    for (int octant = 0; octant < 8; octant++) {
+        int childIndex = firstChild + octant;
+        if (nodes[childIndex].particleCount > 0) {
+            subdivide(childIndex, positions, depth + 1);
+        }
+        // nodes may have been reallocated by the recursive call
+        weightedPosition += nodes[childIndex].centerOfMass * nodes[childIndex].mass;
+        mass += nodes[childIndex].mass;
+    }
+    nodes[nodeIndex].mass = mass;
+    nodes[nodeIndex].centerOfMass = mass > 0.0f ? weightedPosition / mass : node.center;
+}
+
+glm::vec3 BarnesHutSolver::accelerationAt(uint32_t index, const std::vector<glm::vec4>& positions) const {
+    glm::vec3 pos(positions[index]);
+    glm::vec3 acc(0.0f);
+    float thetaSqr = theta * theta;
+
+    int stack[8 * MAX_TREE_DEPTH + 8];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const OctreeNode& node = nodes[stack[--stackSize]];
+        if (node.particleCount == 0) continue;
+
+        if (node.firstChild < 0) {
+            const uint32_t* indices = particleIndices.data() + node.firstParticle;
+            for (int i = 0; i < node.particleCount; i++) {
+                if (indices[i] == index) continue;
+                const glm::vec4& other = positions[indices[i]];
+                glm::vec3 dir = glm::vec3(other) - pos;
+                float distSqr = glm::dot(dir, dir);
+                acc += dir * (other.w / (std::sqrt(distSqr) * (distSqr + PhysicsConstants::SOFTENING)));
+            }
+            continue;
+        }
+
+        glm::vec3 dir = node.centerOfMass - pos;
+        float distSqr = glm::dot(dir, dir);
+        float width = 2.0f * node.halfSize;
+        if (width * width < thetaSqr * distSqr) {
+            acc += dir * (node.mass / (std::sqrt(distSqr) * (distSqr + PhysicsConstants::SOFTENING)));
+        } else {
+            for (int octant = 0; octant < 8; octant++) {
+                stack[stackSize++] = node.firstChild + octant;
+            }
+        }
+    }
+    return acc * PhysicsConstants::G;
+}
+
+void BarnesHutSolver::computeAccelerations(const std::vector<glm::vec4>& positions,
+                                           std::vector<glm::vec3>& accelerations) {
+    buildTree(positions);
+    accelerations.resize(positions.size());
+    parallelFor(0, positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            accelerations[i] = accelerationAt((uint32_t)i, positions);
+        }
+    });
+}
+
+// the tree still covers every particle, only the walks are limited to the active ones
+void BarnesHutSolver::computeActiveAccelerations(const std::vector<glm::vec4>& positions,
+                                                 const std::vector<uint32_t>& active,
+                                                 std::vector<glm::vec3>& accelerations) {
+    buildTree(positions);
+    accelerations.resize(positions.size());
+    parallelFor(0, active.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            accelerations[active[k]] = accelerationAt(active[k], positions);
+        }
+    }, 64);
+}
@@ -39,6 +39,25 @@ ComputeShader::ComputeShader(const char* computeShaderPath) {
     glAttachShader(this->id, computeShader);
     glLinkProgram(this->id);
     checkCompileErrors(this->id, "PROGRAM");
+    // the program keeps what it needs, the shader object can go right away
+    glDeleteShader(computeShader);
+}
+
+ComputeShader::~ComputeShader() {
+    glDeleteProgram(this->id);
+}
+
+ComputeShader::ComputeShader(ComputeShader&& other) noexcept : id(other.id) {
+    other.id = 0;
+}
+
+ComputeShader& ComputeShader::operator=(ComputeShader&& other) noexcept {
+    if (this != &other) {
+        glDeleteProgram(this->id);
+        this->id = other.id;
+        other.id = 0;
+    }
+    return *this;
 }
 
 void ComputeShader::checkCompileErrors(GLuint shader, const std::string& type) {
@@ -73,6 +92,10 @@ void ComputeShader::setInt(const std::string &name, int value) const {
     glUniform1i(glGetUniformLocation(this->id, name.c_str()), value);
 }
 
+void ComputeShader::setUint(const std::string &name, unsigned int value) const {
+    glUniform1ui(glGetUniformLocation(this->id, name.c_str()), value);
+}
+
 void ComputeShader::setFloat(const std::string &name, float value) const {
     glUniform1f(glGetUniformLocation(this->id, name.c_str()), value);
 }
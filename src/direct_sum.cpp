@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <direct_sum.h>
+#include <parallel.h>
+#include <physics.h>
+#include <simd.h>
+
+// pair terms per block sum in the KAHAN and DOUBLE modes, the GPU kernels' tile size
+static const size_t ACCUMULATION_BLOCK = 128;
+
+DirectSumSolver::DirectSumSolver(Accumulation accumulation) : accumulation(accumulation) {}
+
+void DirectSumSolver::loadPositions(const std::vector<glm::vec4>& positions) {
+    size_t count = positions.size();
+    size_t padded = (count + FloatBatch::WIDTH - 1) / FloatBatch::WIDTH * FloatBatch::WIDTH;
+    x.assign(padded, 0.0f);
+    y.assign(padded, 0.0f);
+    z.assign(padded, 0.0f);
+    mass.assign(padded, 0.0f);
+    for (size_t i = 0; i < count; i++) {
+        x[i] = positions[i].x;
+        y[i] = positions[i].y;
+        z[i] = positions[i].z;
+        mass[i] = positions[i].w;
+    }
+}
+
+glm::vec3 DirectSumSolver::accelerationOf(size_t i) const {
+    if (accumulation != Accumulation::FLOAT) {
+        return blockedAccelerationOf(i);
+    }
+    const FloatBatch softening = FloatBatch::broadcast(PhysicsConstants::SOFTENING);
+    FloatBatch px = FloatBatch::broadcast(x[i]);
+    FloatBatch py = FloatBatch::broadcast(y[i]);
+    FloatBatch pz = FloatBatch::broadcast(z[i]);
+    FloatBatch ax = FloatBatch::broadcast(0.0f);
+    FloatBatch ay = ax, az = ax;
+    for (size_t j = 0; j < x.size(); j += FloatBatch::WIDTH) {
+        FloatBatch dx = FloatBatch::load(&x[j]) - px;
+        FloatBatch dy = FloatBatch::load(&y[j]) - py;
+        FloatBatch dz = FloatBatch::load(&z[j]) - pz;
+        FloatBatch distSqr = fma(dx, dx, fma(dy, dy, dz * dz));
+        // normalize(dir) * m / (r^2 + softening); r == 0 is the particle itself
+        FloatBatch scale = maskPositive(distSqr, FloatBatch::load(&mass[j]) / (sqrt(distSqr) * (distSqr + softening)));
+        ax = fma(dx, scale, ax);
+        ay = fma(dy, scale, ay);
+        az = fma(dz, scale, az);
+    }
+    return glm::vec3(ax.sum(), ay.sum(), az.sum()) * PhysicsConstants::G;
+}
+
+// the same pair terms, summed per block in fp32 lanes; only the block sums go through the
+// compensated (or double) accumulator, so the extra cost is per block rather than per pair
+glm::vec3 DirectSumSolver::blockedAccelerationOf(size_t i) const {
+    const FloatBatch softening = FloatBatch::broadcast(PhysicsConstants::SOFTENING);
+    FloatBatch px = FloatBatch::broadcast(x[i]);
+    FloatBatch py = FloatBatch::broadcast(y[i]);
+    FloatBatch pz = FloatBatch::broadcast(z[i]);
+    glm::dvec3 total(0.0);
+    glm::vec3 sum(0.0f), compensation(0.0f);
+    for (size_t start = 0; start < x.size(); start += ACCUMULATION_BLOCK) {
+        size_t end = std::min(x.size(), start + ACCUMULATION_BLOCK);
+        FloatBatch ax = FloatBatch::broadcast(0.0f);
+        FloatBatch ay = ax, az = ax;
+        for (size_t j = start; j < end; j += FloatBatch::WIDTH) {
+            FloatBatch dx = FloatBatch::load(&x[j]) - px;
+            FloatBatch dy = FloatBatch::load(&y[j]) - py;
+            FloatBatch dz = FloatBatch::load(&z[j]) - pz;
+            FloatBatch distSqr = fma(dx, dx, fma(dy, dy, dz * dz));
+            FloatBatch scale = maskPositive(distSqr, FloatBatch::load(&mass[j]) / (sqrt(distSqr) * (distSqr + softening)));
+            ax = fma(dx, scale, ax);
+            ay = fma(dy, scale, ay);
+            az = fma(dz, scale, az);
+        }
+        glm::vec3 block(ax.sum(), ay.sum(), az.sum());
+        if (accumulation == Accumulation::DOUBLE) {
+            total += glm::dvec3(block);
+        } else {
+            glm::vec3 corrected = block - compensation;
+            glm::vec3 next = sum + corrected;
+            compensation = (next - sum) - corrected;
+            sum = next;
+        }
+    }
+    if (accumulation == Accumulation::DOUBLE) {
+        return glm::vec3(total * (double)PhysicsConstants::G);
+    }
+    return sum * PhysicsConstants::G;
+}
+
+void DirectSumSolver::computeAccelerations(const std::vector<glm::vec4>& positions,
+                                           std::vector<glm::vec3>& accelerations) {
+    loadPositions(positions);
+    accelerations.resize(positions.size());
+    parallelFor(0, positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            accelerations[i] = accelerationOf(i);
+        }
+    });
+}
+
+void DirectSumSolver::computeActiveAccelerations(const std::vector<glm::vec4>& positions,
+                                                 const std::vector<uint32_t>& active,
+                                                 std::vector<glm::vec3>& accelerations) {
+    loadPositions(positions);
+    accelerations.resize(positions.size());
+    parallelFor(0, active.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            accelerations[active[k]] = accelerationOf(active[k]);
+        }
+    }, 16);
+}
+
+// particles per block; a block pair's x/y/z/mass and accumulators stay in L1
+static const size_t BLOCK_SIZE = 256;
+
+// every pair between two different blocks, scattering the reaction onto the second one
+void SymmetricDirectSumSolver::blockPair(size_t first, size_t second, float* ax, float* ay, float* az) const {
+    const FloatBatch softening = FloatBatch::broadcast(PhysicsConstants::SOFTENING);
+    size_t secondEnd = (second + 1) * BLOCK_SIZE;
+    for (size_t i = first * BLOCK_SIZE; i < (first + 1) * BLOCK_SIZE; i++) {
+        FloatBatch px = FloatBatch::broadcast(x[i]);
+        FloatBatch py = FloatBatch::broadcast(y[i]);
+        FloatBatch pz = FloatBatch::broadcast(z[i]);
+        FloatBatch mi = FloatBatch::broadcast(mass[i]);
+        FloatBatch sumX = FloatBatch::broadcast(0.0f);
+        FloatBatch sumY = sumX, sumZ = sumX;
+        for (size_t j = second * BLOCK_SIZE; j < secondEnd; j += FloatBatch::WIDTH) {
+            FloatBatch dx = FloatBatch::load(&x[j]) - px;
+            FloatBatch dy = FloatBatch::load(&y[j]) - py;
+            FloatBatch dz = FloatBatch::load(&z[j]) - pz;
+            FloatBatch distSqr = fma(dx, dx, fma(dy, dy, dz * dz));
+            FloatBatch weight = maskPositive(distSqr, FloatBatch::broadcast(1.0f) / (sqrt(distSqr) * (distSqr + softening)));
+            FloatBatch onI = FloatBatch::load(&mass[j]) * weight;
+            sumX = fma(dx, onI, sumX);
+            sumY = fma(dy, onI, sumY);
+            sumZ = fma(dz, onI, sumZ);
+            FloatBatch onJ = mi * weight;
+            (FloatBatch::load(&ax[j]) - dx * onJ).store(&ax[j]);
+            (FloatBatch::load(&ay[j]) - dy * onJ).store(&ay[j]);
+            (FloatBatch::load(&az[j]) - dz * onJ).store(&az[j]);
+        }
+        ax[i] += sumX.sum();
+        ay[i] += sumY.sum();
+        az[i] += sumZ.sum();
+    }
+}
+
+// pairs inside one block are few, so they are evaluated from both sides like the plain solver
+// rather than paying for masking out the lower triangle
+void SymmetricDirectSumSolver::diagonalBlock(size_t block, float* ax, float* ay, float* az) const {
+    const FloatBatch softening = FloatBatch::broadcast(PhysicsConstants::SOFTENING);
+    size_t begin = block * BLOCK_SIZE, end = begin + BLOCK_SIZE;
+    for (size_t i = begin; i < end; i++) {
+        FloatBatch px = FloatBatch::broadcast(x[i]);
+        FloatBatch py = FloatBatch::broadcast(y[i]);
+        FloatBatch pz = FloatBatch::broadcast(z[i]);
+        FloatBatch sumX = FloatBatch::broadcast(0.0f);
+        FloatBatch sumY = sumX, sumZ = sumX;
+        for (size_t j = begin; j < end; j += FloatBatch::WIDTH) {
+            FloatBatch dx = FloatBatch::load(&x[j]) - px;
+            FloatBatch dy = FloatBatch::load(&y[j]) - py;
+            FloatBatch dz = FloatBatch::load(&z[j]) - pz;
+            FloatBatch distSqr = fma(dx, dx, fma(dy, dy, dz * dz));
+            FloatBatch scale = maskPositive(distSqr, FloatBatch::load(&mass[j]) / (sqrt(distSqr) * (distSqr + softening)));
+            sumX = fma(dx, scale, sumX);
+            sumY = fma(dy, scale, sumY);
+            sumZ = fma(dz, scale, sumZ);
+        }
+        ax[i] += sumX.sum();
+        ay[i] += sumY.sum();
+        az[i] += sumZ.sum();
+    }
+}
+
+void SymmetricDirectSumSolver::computeAccelerations(const std::vector<glm::vec4>& positions,
+                                                    std::vector<glm::vec3>& accelerations) {
+    size_t count = positions.size();
+    size_t blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t padded = blocks * BLOCK_SIZE;
+    x.assign(padded, 0.0f);
+    y.assign(padded, 0.0f);
+    z.assign(padded, 0.0f);
+    mass.assign(padded, 0.0f);
+    for (size_t i = 0; i < count; i++) {
+        x[i] = positions[i].x;
+        y[i] = positions[i].y;
+        z[i] = positions[i].z;
+        mass[i] = positions[i].w;
+    }
+    accelerations.resize(count);
+
+    // block pairs (first <= second) numbered row by row; each worker takes a contiguous share
+    size_t workers = std::max<size_t>(1, std::min<size_t>(workerCount(), blocks * (blocks + 1) / 2));
+    size_t pairCount = blocks * (blocks + 1) / 2;
+    accumulators.resize(workers);
+    parallelFor(0, workers, [&](size_t begin, size_t end) {
+        for (size_t worker = begin; worker < end; worker++) {
+            std::vector<float>& accumulator = accumulators[worker];
+            accumulator.assign(3 * padded, 0.0f);
+            float* ax = accumulator.data();
+            float* ay = ax + padded;
+            float* az = ay + padded;
+
+            size_t pair = pairCount * worker / workers, last = pairCount * (worker + 1) / workers;
+            size_t first = 0, rowStart = 0;
+            while (rowStart + (blocks - first) <= pair) {
+                rowStart += blocks - first;
+                first++;
+            }
+            size_t second = first + (pair - rowStart);
+            for (; pair < last; pair++) {
+                if (first == second) {
+                    diagonalBlock(first, ax, ay, az);
+                } else {
+                    blockPair(first, second, ax, ay, az);
+                }
+                if (++second == blocks) {
+                    first++;
+                    second = first;
+                }
+            }
+        }
+    }, 1);
+
+    parallelFor(0, count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            glm::vec3 acc(0.0f);
+            for (size_t worker = 0; worker < workers; worker++) {
+                const float* accumulator = accumulators[worker].data();
+                acc += glm::vec3(accumulator[i], accumulator[padded + i], accumulator[2 * padded + i]);
+            }
+            accelerations[i] = acc * PhysicsConstants::G;
+        }
+    }, 4096);
+}
@@ -0,0 +1,89 @@
+#include <cmath>
+#include <fft.h>
+#include <parallel.h>
+
+Fft3d::Fft3d(int size) : size(size) {
+    twiddles.resize(size / 2);
+    for (int k = 0; k < size / 2; k++) {
+        double angle = -2.0 * M_PI * k / size;
+        twiddles[k] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+    }
+
+    int bits = 0;
+    while ((1 << bits) < size) bits++;
+    bitReverse.resize(size);
+    for (int i = 0; i < size; i++) {
+        uint32_t reversed = 0;
+        for (int bit = 0; bit < bits; bit++) {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        bitReverse[i] = reversed;
+    }
+}
+
+// iterative Cooley-Tukey; the butterflies multiply by hand because std::complex operator* goes
+// through the NaN-checking library call without -ffast-math
+void Fft3d::transformLine(std::complex<float>* line, bool inverse) const {
+    for (int i = 0; i < size; i++) {
+        int j = (int)bitReverse[i];
+        if (i < j) std::swap(line[i], line[j]);
+    }
+
+    float sign = inverse ? -1.0f : 1.0f;
+    for (int length = 2; length <= size; length <<= 1) {
+        int half = length / 2;
+        int step = size / length;
+        for (int start = 0; start < size; start += length) {
+            for (int k = 0; k < half; k++) {
+                float wr = twiddles[k * step].real();
+                float wi = sign * twiddles[k * step].imag();
+                std::complex<float>& a = line[start + k];
+                std::complex<float>& b = line[start + k + half];
+                float vr = b.real() * wr - b.imag() * wi;
+                float vi = b.real() * wi + b.imag() * wr;
+                b = std::complex<float>(a.real() - vr, a.imag() - vi);
+                a = std::complex<float>(a.real() + vr, a.imag() + vi);
+            }
+        }
+    }
+}
+
+// stride 1, size or size^2 selects the x, y or z axis
+void Fft3d::transformAxis(std::vector<std::complex<float>>& grid, size_t stride, bool inverse) const {
+    size_t n = size;
+    parallelFor(0, n * n, [&](size_t begin, size_t end) {
+        std::vector<std::complex<float>> line(n);
+        for (size_t lineIndex = begin; lineIndex < end; lineIndex++) {
+            // the two axes other than the transformed one
+            size_t outer = lineIndex / n, inner = lineIndex % n;
+            size_t first = stride == 1 ? lineIndex * n
+                         : stride == n ? outer * n * n + inner
+                         : lineIndex;
+            if (stride == 1) {
+                transformLine(&grid[first], inverse);
+                continue;
+            }
+            for (size_t i = 0; i < n; i++) line[i] = grid[first + i * stride];
+            transformLine(line.data(), inverse);
+            for (size_t i = 0; i < n; i++) grid[first + i * stride] = line[i];
+        }
+    }, 16);
+}
+
+void Fft3d::forward(std::vector<std::complex<float>>& grid) const {
+    size_t n = size;
+    transformAxis(grid, 1, false);
+    transformAxis(grid, n, false);
+    transformAxis(grid, n * n, false);
+}
+
+void Fft3d::inverse(std::vector<std::complex<float>>& grid) const {
+    size_t n = size;
+    transformAxis(grid, 1, true);
+    transformAxis(grid, n, true);
+    transformAxis(grid, n * n, true);
+    float scale = 1.0f / (float)(n * n * n);
+    parallelFor(0, grid.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) grid[i] *= scale;
+    }, 65536);
+}
@@ -0,0 +1,17 @@
+#include <algorithm>
+#include <cmath>
+#include <fixed_timestep.h>
+
+FixedTimestep::FixedTimestep(float stepSize, int maxSubsteps) : stepSize(stepSize), maxSubsteps(std::max(1, maxSubsteps)) {}
+
+int FixedTimestep::advance(float frameTime) {
+    accumulator += std::max(0.0f, frameTime);
+    long long steps = (long long)(accumulator / stepSize);
+    if (steps > maxSubsteps) {
+        droppedSteps += steps - maxSubsteps;
+        accumulator = std::fmod(accumulator, (double)stepSize);
+        return maxSubsteps;
+    }
+    accumulator -= steps * (double)stepSize;
+    return (int)steps;
+}
@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <cmath>
+#include <fmm.h>
+#include <parallel.h>
+#include <physics.h>
+
+// coincident particles would otherwise subdivide forever
+static const int MAX_TREE_DEPTH = 32;
+
+FmmSolver::FmmSolver(int order, int leafSize, float theta)
+    : order(std::min(15, std::max(1, order))), leafSize(std::max(1, leafSize)), theta(theta) {
+    termIndex.assign((this->order + 1) * (this->order + 1) * (this->order + 1), -1);
+    for (int n = 0; n <= this->order; n++) {
+        for (int a = n; a >= 0; a--) {
+            for (int b = n - a; b >= 0; b--) {
+                int c = n - a - b;
+                termIndex[(a * (this->order + 1) + b) * (this->order + 1) + c] = (int)terms.size();
+                terms.emplace_back(a, b, c);
+            }
+        }
+    }
+    factorials.resize(this->order + 1);
+    factorials[0] = 1.0;
+    for (int n = 1; n <= this->order; n++) {
+        factorials[n] = factorials[n - 1] * n;
+    }
+}
+
+// y^a / a! for every term, the building block of all the expansion shifts
+static void scaledMonomials(const glm::dvec3& y, int order, const std::vector<glm::ivec3>& terms,
+                            const std::vector<double>& factorials, double* out) {
+    double px[16], py[16], pz[16];
+    px[0] = py[0] = pz[0] = 1.0;
+    for (int n = 1; n <= order; n++) {
+        px[n] = px[n - 1] * y.x;
+        py[n] = py[n - 1] * y.y;
+        pz[n] = pz[n - 1] * y.z;
+    }
+    for (size_t t = 0; t < terms.size(); t++) {
+        const glm::ivec3& term = terms[t];
+        out[t] = px[term.x] * py[term.y] * pz[term.z] / (factorials[term.x] * factorials[term.y] * factorials[term.z]);
+    }
+}
+
+void FmmSolver::buildTree(const std::vector<glm::vec4>& positions) {
+    cells.clear();
+    particleIndices.resize(positions.size());
+    scratchIndices.resize(positions.size());
+    for (uint32_t i = 0; i < positions.size(); i++) {
+        particleIndices[i] = i;
+    }
+
+    glm::vec3 lower(INFINITY), upper(-INFINITY);
+    for (const glm::vec4& p : positions) {
+        lower = glm::min(lower, glm::vec3(p));
+        upper = glm::max(upper, glm::vec3(p));
+    }
+    if (positions.empty()) {
+        lower = upper = glm::vec3(0.0f);
+    }
+
+    FmmCell root{};
+    root.center = glm::dvec3(lower + upper) * 0.5;
+    // pad slightly so particles on the upper faces still land strictly inside the root cell
+    root.halfSize = std::max(1e-6, (double)std::max(upper.x - lower.x, std::max(upper.y - lower.y, upper.z - lower.z)) * 0.5 * 1.0001);
+    root.firstChild = -1;
+    root.firstParticle = 0;
+    root.particleCount = (int)positions.size();
+    cells.push_back(root);
+    subdivide(0, positions, 0);
+}
+
+void FmmSolver::subdivide(int cellIndex, const std::vector<glm::vec4>& positions, int depth) {
+    FmmCell cell = cells[cellIndex];
+    if (cell.particleCount <= leafSize || depth >= MAX_TREE_DEPTH) {
+        return;
+    }
+
+    // bucket this cell's index range by octant (counting sort, stable)
+    uint32_t* indices = particleIndices.data() + cell.firstParticle;
+    auto octantOf = [&](uint32_t index) {
+        glm::dvec3 p(positions[index]);
+        return (p.x > cell.center.x ? 1 : 0) | (p.y > cell.center.y ? 2 : 0) | (p.z > cell.center.z ? 4 : 0);
+    };
+    int counts[8] = {};
+    for (int i = 0; i < cell.particleCount; i++) {
+        counts[octantOf(indices[i])]++;
+    }
+    int offsets[8];
+    offsets[0] = 0;
+    for (int octant = 1; octant < 8; octant++) {
+        offsets[octant] = offsets[octant - 1] + counts[octant - 1];
+    }
+    uint32_t* sorted = scratchIndices.data() + cell.firstParticle;
+    int cursor[8];
+    std::copy(offsets, offsets + 8, cursor);
+    for (int i = 0; i < cell.particleCount; i++) {
+        sorted[cursor[octantOf(indices[i])]++] = indices[i];
+    }
+    std::copy(sorted, sorted + cell.particleCount, indices);
+
+    int firstChild = (int)cells.size();
+    double childHalfSize = cell.halfSize * 0.5;
+    for (int octant = 0; octant < 8; octant++) {
+        if (counts[octant] == 0) continue;
+        FmmCell child{};
+        child.center = cell.center + glm::dvec3(
+            (octant & 1) ? childHalfSize : -childHalfSize,
+            (octant & 2) ? childHalfSize : -childHalfSize,
+            (octant & 4) ? childHalfSize : -childHalfSize);
+        child.halfSize = childHalfSize;
+        child.firstChild = -1;
+        child.firstParticle = cell.firstParticle + offsets[octant];
+        child.particleCount = counts[octant];
+        cells.push_back(child);
+    }
+    cells[cellIndex].firstChild = firstChild;
+    cells[cellIndex].childCount = (int)cells.size() - firstChild;
+    for (int child = firstChild; child < firstChild + cells[cellIndex].childCount; child++) {
+        subdivide(child, positions, depth + 1);
+    }
+}
+
+// children always come after their parent, so walking the cells backwards visits children first
+void FmmSolver::computeMultipoles(const std::vector<glm::vec4>& positions) {
+    size_t termCount = terms.size();
+    multipoles.assign(cells.size() * termCount, 0.0);
+    std::vector<double> monomials(termCount);
+    for (int c = (int)cells.size() - 1; c >= 0; c--) {
+        FmmCell& cell = cells[c];
+        double* multipole = &multipoles[c * termCount];
+
+        if (cell.firstChild < 0) {
+            const uint32_t* indices = particleIndices.data() + cell.firstParticle;
+            glm::dvec3 weightedPosition(0.0);
+            double mass = 0.0;
+            for (int i = 0; i < cell.particleCount; i++) {
+                const glm::vec4& p = positions[indices[i]];
+                weightedPosition += glm::dvec3(p) * (double)p.w;
+                mass += p.w;
+            }
+            cell.centerOfMass = mass > 0.0 ? weightedPosition / mass : cell.center;
+            cell.radius = 0.0;
+            for (int i = 0; i < cell.particleCount; i++) {
+                const glm::vec4& p = positions[indices[i]];
+                glm::dvec3 offset = glm::dvec3(p) - cell.centerOfMass;
+                cell.radius = std::max(cell.radius, glm::length(offset));
+                scaledMonomials(offset, order, terms, factorials, monomials.data());
+                for (size_t t = 0; t < termCount; t++) {
+                    multipole[t] += p.w * monomials[t];
+                }
+            }
+            continue;
+        }
+
+        glm::dvec3 weightedPosition(0.0);
+        double mass = 0.0;
+        for (int child = cell.firstChild; child < cell.firstChild + cell.childCount; child++) {
+            double childMass = multipoles[child * termCount];
+            weightedPosition += cells[child].centerOfMass * childMass;
+            mass += childMass;
+        }
+        cell.centerOfMass = mass > 0.0 ? weightedPosition / mass : cell.center;
+        cell.radius = glm::length(cell.centerOfMass - cell.center) + std::sqrt(3.0) * cell.halfSize;
+
+        // M2M: M_parent[a] = sum over b <= a of M_child[b] (z_child - z_parent)^(a - b) / (a - b)!
+        double childRadius = 0.0;
+        for (int child = cell.firstChild; child < cell.firstChild + cell.childCount; child++) {
+            glm::dvec3 shift = cells[child].centerOfMass - cell.centerOfMass;
+            childRadius = std::max(childRadius, glm::length(shift) + cells[child].radius);
+            scaledMonomials(shift, order, terms, factorials, monomials.data());
+            const double* childMultipole = &multipoles[child * termCount];
+            for (size_t t = 0; t < termCount; t++) {
+                const glm::ivec3& a = terms[t];
+                double sum = 0.0;
+                for (int bx = 0; bx <= a.x; bx++) {
+                    for (int by = 0; by <= a.y; by++) {
+                        for (int bz = 0; bz <= a.z; bz++) {
+                            sum += childMultipole[indexOf(bx, by, bz)] * monomials[indexOf(a.x - bx, a.y - by, a.z - bz)];
+                        }
+                    }
+                }
+                multipole[t] += sum;
+            }
+        }
+        cell.radius = std::min(cell.radius, childRadius);
+    }
+}
+
+// dual tree walk: cells far enough apart translate, otherwise the larger one is opened
+void FmmSolver::buildInteractionLists(int target, int source) {
+    const FmmCell& a = cells[target];
+    const FmmCell& b = cells[source];
+    double targetRadius = glm::length(a.center - a.centerOfMass) + a.radius;
+    double distance = glm::length(a.center - b.centerOfMass);
+    if (target != source && targetRadius + b.radius < theta * distance) {
+        farLists[target].push_back(source);
+    } else if (a.firstChild < 0 && b.firstChild < 0) {
+        nearLists[target].push_back(source);
+    } else if (b.firstChild < 0 || (a.firstChild >= 0 && a.halfSize >= b.halfSize)) {
+        for (int child = a.firstChild; child < a.firstChild + a.childCount; child++) {
+            buildInteractionLists(child, source);
+        }
+    } else {
+        for (int child = b.firstChild; child < b.firstChild + b.childCount; child++) {
+            buildInteractionLists(target, child);
+        }
+    }
+}
+
+// derivatives of phi(|r|^2) for every term up to the expansion order. With g_k = d^k phi / dq^k,
+// q = |r|^2, each axis contributes d^a/dx^a = sum_i a! / (i! (a - 2i)!) (2x)^(a - 2i) d^(a - i)/dq^(a - i).
+// The softened potential has phi' = G / (2 sqrt(q) (q + s)), whose higher derivatives follow from
+// the Leibniz rule on q^(-1/2) and (q + s)^(-1).
+void FmmSolver::derivativeTensor(const glm::dvec3& r, std::vector<double>& derivatives) const {
+    double q = glm::dot(r, r);
+    double softening = PhysicsConstants::SOFTENING;
+    double softeningLength = std::sqrt(softening);
+
+    double g[16], rootTerms[16], softTerms[16];
+    // rootTerms[j] = d^j q^(-1/2), softTerms[i] = d^i (q + s)^(-1)
+    rootTerms[0] = 1.0 / std::sqrt(q);
+    softTerms[0] = 1.0 / (q + softening);
+    for (int j = 1; j < order; j++) {
+        rootTerms[j] = rootTerms[j - 1] * -(2.0 * j - 1.0) / (2.0 * q);
+        softTerms[j] = softTerms[j - 1] * -(double)j / (q + softening);
+    }
+    g[0] = -PhysicsConstants::G * (M_PI_2 - std::atan(std::sqrt(q) / softeningLength)) / softeningLength;
+    for (int m = 1; m <= order; m++) {
+        double sum = 0.0, binomial = 1.0;
+        for (int j = 0; j <= m - 1; j++) {
+            sum += binomial * rootTerms[j] * softTerms[m - 1 - j];
+            binomial = binomial * (m - 1 - j) / (j + 1);
+        }
+        g[m] = 0.5 * PhysicsConstants::G * sum;
+    }
+
+    // hermite[a][i] * (2x)^(a - 2i), per axis
+    double axisTerms[3][16][8];
+    for (int axis = 0; axis < 3; axis++) {
+        double twoX = 2.0 * r[axis];
+        for (int a = 0; a <= order; a++) {
+            for (int i = 0; 2 * i <= a; i++) {
+                axisTerms[axis][a][i] = factorials[a] / (factorials[i] * factorials[a - 2 * i]) * std::pow(twoX, a - 2 * i);
+            }
+        }
+    }
+
+    derivatives.resize(terms.size());
+    for (size_t t = 0; t < terms.size(); t++) {
+        const glm::ivec3& term = terms[t];
+        int n = term.x + term.y + term.z;
+        double sum = 0.0;
+        for (int i = 0; 2 * i <= term.x; i++) {
+            for (int j = 0; 2 * j <= term.y; j++) {
+                for (int k = 0; 2 * k <= term.z; k++) {
+                    sum += axisTerms[0][term.x][i] * axisTerms[1][term.y][j] * axisTerms[2][term.z][k] * g[n - i - j - k];
+                }
+            }
+        }
+        derivatives[t] = sum;
+    }
+}
+
+// L_target[b] += sum over |a| + |b| <= order of (-1)^|a| M_source[a] D[a + b](z_target - z_source)
+void FmmSolver::translateMultipoleToLocal(int target, int source, std::vector<double>& derivatives) {
+    size_t termCount = terms.size();
+    derivativeTensor(cells[target].center - cells[source].centerOfMass, derivatives);
+    const double* multipole = &multipoles[source * termCount];
+    double* local = &locals[target * termCount];
+    for (size_t tb = 0; tb < termCount; tb++) {
+        const glm::ivec3& b = terms[tb];
+        int remaining = order - (b.x + b.y + b.z);
+        double sum = 0.0;
+        for (size_t ta = 0; ta < termCount; ta++) {
+            const glm::ivec3& a = terms[ta];
+            int n = a.x + a.y + a.z;
+            // terms are ordered by total degree
+            if (n > remaining) break;
+            double value = multipole[ta] * derivatives[indexOf(a.x + b.x, a.y + b.y, a.z + b.z)];
+            sum += (n & 1) ? -value : value;
+        }
+        local[tb] += sum;
+    }
+}
+
+// L2L: L_child[b] += sum over g of L_parent[b + g] (z_child - z_parent)^g / g!, parents first
+void FmmSolver::translateLocals() {
+    size_t termCount = terms.size();
+    std::vector<double> monomials(termCount);
+    for (size_t c = 0; c < cells.size(); c++) {
+        const FmmCell& cell = cells[c];
+        const double* local = &locals[c * termCount];
+        for (int child = cell.firstChild; child < cell.firstChild + cell.childCount; child++) {
+            scaledMonomials(cells[child].center - cell.center, order, terms, factorials, monomials.data());
+            double* childLocal = &locals[child * termCount];
+            for (size_t tb = 0; tb < termCount; tb++) {
+                const glm::ivec3& b = terms[tb];
+                int remaining = order - (b.x + b.y + b.z);
+                double sum = 0.0;
+                for (size_t tg = 0; tg < termCount; tg++) {
+                    const glm::ivec3& g = terms[tg];
+                    if (g.x + g.y + g.z > remaining) break;
+                    sum += local[indexOf(b.x + g.x, b.y + g.y, b.z + g.z)] * monomials[tg];
+                }
+                childLocal[tb] += sum;
+            }
+        }
+    }
+}
+
+glm::vec3 FmmSolver::evaluateLeaf(const FmmCell& leaf, const glm::vec4& position, uint32_t index,
+                                  const std::vector<glm::vec4>& positions) const {
+    // far field: a = -grad of the local expansion, sum over |b| < order of L[b + e_k] y^b / b!
+    size_t termCount = terms.size();
+    const double* local = &locals[(&leaf - cells.data()) * termCount];
+    double monomials[1024];
+    scaledMonomials(glm::dvec3(position) - leaf.center, order, terms, factorials, monomials);
+    glm::dvec3 far(0.0);
+    for (size_t tb = 0; tb < termCount; tb++) {
+        const glm::ivec3& b = terms[tb];
+        if (b.x + b.y + b.z >= order) break;
+        far.x -= local[indexOf(b.x + 1, b.y, b.z)] * monomials[tb];
+        far.y -= local[indexOf(b.x, b.y + 1, b.z)] * monomials[tb];
+        far.z -= local[indexOf(b.x, b.y, b.z + 1)] * monomials[tb];
+    }
+
+    // near field: the same pair interaction as the direct sum
+    glm::vec3 pos(position);
+    glm::vec3 near(0.0f);
+    for (int source : nearLists[&leaf - cells.data()]) {
+        const FmmCell& sourceLeaf = cells[source];
+        const uint32_t* indices = particleIndices.data() + sourceLeaf.firstParticle;
+        for (int i = 0; i < sourceLeaf.particleCount; i++) {
+            if (indices[i] == index) continue;
+            const glm::vec4& other = positions[indices[i]];
+            glm::vec3 dir = glm::vec3(other) - pos;
+            float distSqr = glm::dot(dir, dir);
+            if (distSqr == 0.0f) continue;
+            near += dir * (other.w / (std::sqrt(distSqr) * (distSqr + PhysicsConstants::SOFTENING)));
+        }
+    }
+    return glm::vec3(far) + near * PhysicsConstants::G;
+}
+
+void FmmSolver::computeAccelerations(const std::vector<glm::vec4>& positions,
+                                     std::vector<glm::vec3>& accelerations) {
+    accelerations.assign(positions.size(), glm::vec3(0.0f));
+    if (positions.empty()) return;
+
+    buildTree(positions);
+    computeMultipoles(positions);
+
+    farLists.assign(cells.size(), {});
+    nearLists.assign(cells.size(), {});
+    buildInteractionLists(0, 0);
+
+    locals.assign(cells.size() * terms.size(), 0.0);
+    parallelFor(0, cells.size(), [&](size_t begin, size_t end) {
+        std::vector<double> derivatives;
+        for (size_t c = begin; c < end; c++) {
+            for (int source : farLists[c]) {
+                translateMultipoleToLocal((int)c, source, derivatives);
+            }
+        }
+    }, 16);
+    translateLocals();
+
+    parallelFor(0, cells.size(), [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            const FmmCell& cell = cells[c];
+            if (cell.firstChild >= 0) continue;
+            const uint32_t* indices = particleIndices.data() + cell.firstParticle;
+            for (int i = 0; i < cell.particleCount; i++) {
+                accelerations[indices[i]] = evaluateLeaf(cell, positions[indices[i]], indices[i], positions);
+            }
+        }
+    }, 16);
+}
@@ -0,0 +1,34 @@
+#include <algorithm>
+#include <cmath>
+#include <force_solver.h>
+
+void ForceSolver::computeActiveAccelerations(const std::vector<glm::vec4>& positions,
+                                             const std::vector<uint32_t>& active,
+                                             std::vector<glm::vec3>& accelerations) {
+    std::vector<glm::vec3> all;
+    computeAccelerations(positions, all);
+    accelerations.resize(positions.size());
+    for (uint32_t i : active) {
+        accelerations[i] = all[i];
+    }
+}
+
+float maxRelativeError(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& approx) {
+    float maxError = 0.0f;
+    for (size_t i = 0; i < reference.size() && i < approx.size(); i++) {
+        float referenceLength = glm::length(reference[i]);
+        if (referenceLength == 0.0f) continue;
+        maxError = std::max(maxError, glm::length(approx[i] - reference[i]) / referenceLength);
+    }
+    return maxError;
+}
+
+float rmsRelativeError(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& approx) {
+    double errorSqr = 0.0, referenceSqr = 0.0;
+    for (size_t i = 0; i < reference.size() && i < approx.size(); i++) {
+        glm::vec3 error = approx[i] - reference[i];
+        errorSqr += glm::dot(error, error);
+        referenceSqr += glm::dot(reference[i], reference[i]);
+    }
+    return referenceSqr > 0.0 ? (float)std::sqrt(errorSqr / referenceSqr) : 0.0f;
+}
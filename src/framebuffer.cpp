@@ -0,0 +1,52 @@
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <framebuffer.h>
+
+OffscreenFramebuffer::OffscreenFramebuffer(int width, int height) : width(width), height(height) {
+    glGenRenderbuffers(1, &colorRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &depthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR::FRAMEBUFFER::INCOMPLETE" << std::endl;
+    }
+}
+
+OffscreenFramebuffer::~OffscreenFramebuffer() {
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &colorRenderbuffer);
+    glDeleteRenderbuffers(1, &depthRenderbuffer);
+}
+
+void OffscreenFramebuffer::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+}
+
+bool OffscreenFramebuffer::writePpm(const std::string& path) const {
+    std::vector<unsigned char> pixels((size_t)width * height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "ERROR::FRAMEBUFFER::COULD_NOT_OPEN " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << width << ' ' << height << "\n255\n";
+    // GL rows start at the bottom of the image, PPM rows at the top
+    for (int row = height - 1; row >= 0; row--) {
+        file.write((const char*)pixels.data() + (size_t)row * width * 3, (std::streamsize)width * 3);
+    }
+    return (bool)file;
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <gpu_primitives.h>
+
+// elements per workgroup: scan.glsl handles two per invocation, the radix kernels one
+static const uint32_t SCAN_BLOCK = 512;
+static const uint32_t SORT_BLOCK = 256;
+static const uint32_t RADIX = 16;
+
+static GLuint groupsFor(uint32_t count, uint32_t block) {
+    return (count + block - 1) / block;
+}
+
+void ensureBufferSize(GLuint& buffer, size_t& capacity, size_t bytes) {
+    if (buffer != 0 && capacity >= bytes) return;
+    if (buffer == 0) glGenBuffers(1, &buffer);
+    // grow geometrically so a slowly increasing count does not reallocate every call
+    capacity = std::max(bytes, capacity * 3 / 2);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity, nullptr, GL_DYNAMIC_COPY);
+}
+
+GpuScan::GpuScan() : scanShader("../shaders/scan.glsl"), addShader("../shaders/scan_add.glsl") {}
+
+GpuScan::~GpuScan() {
+    glDeleteBuffers((GLsizei)levelBuffers.size(), levelBuffers.data());
+}
+
+void GpuScan::exclusiveScan(GLuint input, GLuint output, uint32_t count) {
+    if (count == 0) return;
+    scanLevel(input, output, count, 0);
+}
+
+// scans every block, scans the block totals (recursively, in place) and adds them back
+void GpuScan::scanLevel(GLuint input, GLuint output, uint32_t count, size_t level) {
+    if (levelBuffers.size() <= level) {
+        levelBuffers.push_back(0);
+        levelCapacities.push_back(0);
+    }
+    GLuint blocks = groupsFor(count, SCAN_BLOCK);
+    ensureBufferSize(levelBuffers[level], levelCapacities[level], blocks * sizeof(uint32_t));
+    GLuint blockSums = levelBuffers[level];
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, input);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, output);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, blockSums);
+    scanShader.use();
+    scanShader.setUint("count", count);
+    glDispatchCompute(blocks, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    if (blocks == 1) return;
+
+    scanLevel(blockSums, blockSums, blocks, level + 1);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, output);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, blockSums);
+    addShader.use();
+    addShader.setUint("count", count);
+    glDispatchCompute(blocks, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+GpuCompaction::GpuCompaction() : compactShader("../shaders/compact.glsl") {}
+
+GpuCompaction::~GpuCompaction() {
+    glDeleteBuffers(1, &offsetBuffer);
+}
+
+uint32_t GpuCompaction::compact(GLuint flags, GLuint values, GLuint output, uint32_t count) {
+    if (count == 0) return 0;
+    ensureBufferSize(offsetBuffer, offsetCapacity, count * sizeof(uint32_t));
+    scan.exclusiveScan(flags, offsetBuffer, count);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, flags);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, offsetBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, values);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, output);
+    compactShader.use();
+    compactShader.setUint("count", count);
+    glDispatchCompute(groupsFor(count, SORT_BLOCK), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    // exclusive scan total = last offset + last flag
+    uint32_t lastOffset = 0, lastFlag = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, offsetBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, (count - 1) * sizeof(uint32_t), sizeof(uint32_t), &lastOffset);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, flags);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, (count - 1) * sizeof(uint32_t), sizeof(uint32_t), &lastFlag);
+    return lastOffset + (lastFlag != 0 ? 1 : 0);
+}
+
+GpuRadixSort::GpuRadixSort()
+    : histogramShader("../shaders/radix_histogram.glsl"), scatterShader("../shaders/radix_scatter.glsl") {}
+
+GpuRadixSort::~GpuRadixSort() {
+    glDeleteBuffers(1, &keyScratch);
+    glDeleteBuffers(1, &valueScratch);
+    glDeleteBuffers(1, &countBuffer);
+}
+
+// each pass: per-workgroup digit counts, one scan over all of them (digit-major, so the scan
+// yields every block's first slot for each digit), then a stable scatter into the other buffer
+void GpuRadixSort::sort(GLuint keys, GLuint values, uint32_t count, int keyBits) {
+    if (count <= 1 || keyBits <= 0) return;
+    keyBits = std::min(keyBits, 64);
+    uint32_t keyWords = keyBits > 32 ? 2 : 1;
+    GLuint groups = groupsFor(count, SORT_BLOCK);
+    ensureBufferSize(keyScratch, keyCapacity, (size_t)count * keyWords * sizeof(uint32_t));
+    ensureBufferSize(valueScratch, valueCapacity, (size_t)count * sizeof(uint32_t));
+    ensureBufferSize(countBuffer, countCapacity, (size_t)groups * RADIX * sizeof(uint32_t));
+
+    GLuint keyBuffers[2] = {keys, keyScratch};
+    GLuint valueBuffers[2] = {values, valueScratch};
+    int passes = (keyBits + 3) / 4;
+    for (int pass = 0; pass < passes; pass++) {
+        int source = pass % 2;
+        uint32_t shift = (uint32_t)pass * 4;
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, keyBuffers[source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, countBuffer);
+        histogramShader.use();
+        histogramShader.setUint("count", count);
+        histogramShader.setUint("keyWords", keyWords);
+        histogramShader.setUint("shift", shift);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        scan.exclusiveScan(countBuffer, countBuffer, groups * RADIX);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, keyBuffers[source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, valueBuffers[source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, keyBuffers[1 - source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, valueBuffers[1 - source]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, countBuffer);
+        scatterShader.use();
+        scatterShader.setUint("count", count);
+        scatterShader.setUint("keyWords", keyWords);
+        scatterShader.setUint("shift", shift);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // an odd pass count leaves the result in the scratch pair
+    if (passes % 2 == 1) {
+        glBindBuffer(GL_COPY_READ_BUFFER, keyScratch);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, keys);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (size_t)count * keyWords * sizeof(uint32_t));
+        glBindBuffer(GL_COPY_READ_BUFFER, valueScratch);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, values);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (size_t)count * sizeof(uint32_t));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
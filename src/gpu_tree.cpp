@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <gpu_tree.h>
+
+GpuTree::GpuTree() : mortonShader("../shaders/morton_keys.glsl"), buildShader("../shaders/lbvh_build.glsl") {}
+
+GpuTree::~GpuTree() {
+    GLuint buffers[] = {keyBuffer, orderBuffer, boundsBuffer, nodeBuffer, arrivalBuffer, overflowBuffer};
+    glDeleteBuffers(6, buffers);
+}
+
+void GpuTree::reserve(uint32_t count) {
+    if (overflowBuffer == 0) {
+        const uint32_t zero = 0;
+        glGenBuffers(1, &overflowBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, overflowBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), &zero, GL_DYNAMIC_COPY);
+    }
+    size_t previousOrderCapacity = orderCapacity;
+    ensureBufferSize(keyBuffer, keyCapacity, (size_t)count * 2 * sizeof(uint32_t));
+    ensureBufferSize(orderBuffer, orderCapacity, (size_t)count * sizeof(uint32_t));
+    ensureBufferSize(boundsBuffer, boundsCapacity, 6 * sizeof(uint32_t));
+    ensureBufferSize(nodeBuffer, nodeCapacity, (size_t)(count == 0 ? 1 : 2 * count - 1) * sizeof(GpuTreeNode));
+    ensureBufferSize(arrivalBuffer, arrivalCapacity, (size_t)std::max(1u, count) * sizeof(uint32_t));
+    if (orderCapacity != previousOrderCapacity) {
+        std::vector<uint32_t> identity(orderCapacity / sizeof(uint32_t));
+        std::iota(identity.begin(), identity.end(), 0u);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, orderBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, identity.size() * sizeof(uint32_t), identity.data());
+    }
+}
+
+void GpuTree::build(GLuint positions, uint32_t count) {
+    this->count = count;
+    if (count == 0) return;
+    reserve(count);
+    GLuint groups = (count + 255) / 256;
+
+    const uint32_t emptyBounds[6] = {0xffffffffu, 0xffffffffu, 0xffffffffu, 0u, 0u, 0u};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(emptyBounds), emptyBounds);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, boundsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, keyBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, orderBuffer);
+    mortonShader.use();
+    mortonShader.setUint("count", count);
+    for (int stage = 0; stage < 2; stage++) {
+        mortonShader.setInt("stage", stage);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    sort.sort(keyBuffer, orderBuffer, count, 63);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, keyBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, orderBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, nodeBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, arrivalBuffer);
+    buildShader.use();
+    buildShader.setUint("count", count);
+    for (int stage = 0; stage < 3; stage++) {
+        buildShader.setInt("stage", stage);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+}
+
+uint32_t GpuTree::readStackOverflows() const {
+    if (overflowBuffer == 0) return 0;
+    uint32_t overflows = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, overflowBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(overflows), &overflows);
+    return overflows;
+}
@@ -0,0 +1,73 @@
+#include <cmath>
+#include <hermite.h>
+#include <parallel.h>
+#include <physics.h>
+#include <simd.h>
+
+// the pair term is m d f(r) with f = 1 / (r (r^2 + s)); its time derivative is
+// m (v f - d (3 r^2 + s) f^2 (d . v) / r) for the relative position d and velocity v
+void HermiteDirectSum::evaluate(const std::vector<glm::vec4>& positions, const std::vector<glm::vec4>& velocities,
+                                const std::vector<uint32_t>& active,
+                                std::vector<glm::vec3>& accelerations, std::vector<glm::vec3>& jerks) {
+    size_t count = positions.size();
+    size_t padded = (count + FloatBatch::WIDTH - 1) / FloatBatch::WIDTH * FloatBatch::WIDTH;
+    for (std::vector<float>* component : {&x, &y, &z, &vx, &vy, &vz, &mass}) {
+        component->assign(padded, 0.0f);
+    }
+    for (size_t i = 0; i < count; i++) {
+        x[i] = positions[i].x;
+        y[i] = positions[i].y;
+        z[i] = positions[i].z;
+        vx[i] = velocities[i].x;
+        vy[i] = velocities[i].y;
+        vz[i] = velocities[i].z;
+        mass[i] = positions[i].w;
+    }
+    accelerations.resize(count);
+    jerks.resize(count);
+
+    const FloatBatch softening = FloatBatch::broadcast(PhysicsConstants::SOFTENING);
+    const FloatBatch three = FloatBatch::broadcast(3.0f);
+    parallelFor(0, active.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            size_t i = active[k];
+            FloatBatch px = FloatBatch::broadcast(x[i]), py = FloatBatch::broadcast(y[i]), pz = FloatBatch::broadcast(z[i]);
+            FloatBatch qx = FloatBatch::broadcast(vx[i]), qy = FloatBatch::broadcast(vy[i]), qz = FloatBatch::broadcast(vz[i]);
+            FloatBatch ax = FloatBatch::broadcast(0.0f);
+            FloatBatch ay = ax, az = ax, jx = ax, jy = ax, jz = ax;
+            for (size_t j = 0; j < padded; j += FloatBatch::WIDTH) {
+                FloatBatch dx = FloatBatch::load(&x[j]) - px;
+                FloatBatch dy = FloatBatch::load(&y[j]) - py;
+                FloatBatch dz = FloatBatch::load(&z[j]) - pz;
+                FloatBatch dvx = FloatBatch::load(&vx[j]) - qx;
+                FloatBatch dvy = FloatBatch::load(&vy[j]) - qy;
+                FloatBatch dvz = FloatBatch::load(&vz[j]) - qz;
+                FloatBatch distSqr = fma(dx, dx, fma(dy, dy, dz * dz));
+                FloatBatch dist = sqrt(distSqr);
+                // r == 0 is the particle itself
+                FloatBatch f = maskPositive(distSqr, FloatBatch::broadcast(1.0f) / (dist * (distSqr + softening)));
+                FloatBatch m = FloatBatch::load(&mass[j]);
+                FloatBatch scale = m * f;
+                FloatBatch radialVelocity = fma(dx, dvx, fma(dy, dvy, dz * dvz));
+                FloatBatch radial = maskPositive(distSqr, scale * f * fma(three, distSqr, softening) * radialVelocity / dist);
+                ax = fma(dx, scale, ax);
+                ay = fma(dy, scale, ay);
+                az = fma(dz, scale, az);
+                jx = fma(dvx, scale, jx) - dx * radial;
+                jy = fma(dvy, scale, jy) - dy * radial;
+                jz = fma(dvz, scale, jz) - dz * radial;
+            }
+            accelerations[i] = glm::vec3(ax.sum(), ay.sum(), az.sum()) * PhysicsConstants::G;
+            jerks[i] = glm::vec3(jx.sum(), jy.sum(), jz.sum()) * PhysicsConstants::G;
+        }
+    }, 16);
+}
+
+double aarsethTimestep(const glm::vec3& acceleration, const glm::vec3& jerk,
+                       const glm::vec3& snap, const glm::vec3& crackle, float eta) {
+    double a = glm::length(acceleration), a1 = glm::length(jerk);
+    double a2 = glm::length(snap), a3 = glm::length(crackle);
+    double denominator = a1 * a3 + a2 * a2;
+    if (denominator <= 0.0) return INFINITY;
+    return std::sqrt(eta * (a * a2 + a1 * a1) / denominator);
+}
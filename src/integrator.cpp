@@ -0,0 +1,32 @@
+#include <cmath>
+#include <integrator.h>
+
+const std::vector<IntegratorStage>& integratorStages(IntegratorType type) {
+    static const std::vector<IntegratorStage> euler = {
+        {1.0f, 1.0f}
+    };
+    static const std::vector<IntegratorStage> leapfrog = {
+        {0.5f, 1.0f},
+        {0.5f, 0.0f}
+    };
+    // Yoshida (1990): drifts w1, w0, w1 with kicks at the midpoints between them
+    static const double cubeRootTwo = std::cbrt(2.0);
+    static const double w1 = 1.0 / (2.0 - cubeRootTwo);
+    static const double w0 = -cubeRootTwo / (2.0 - cubeRootTwo);
+    static const std::vector<IntegratorStage> yoshida4 = {
+        {(float)(w1 * 0.5), (float)w1},
+        {(float)((w0 + w1) * 0.5), (float)w0},
+        {(float)((w0 + w1) * 0.5), (float)w1},
+        {(float)(w1 * 0.5), 0.0f}
+    };
+
+    switch (type) {
+        case IntegratorType::LEAPFROG:
+            return leapfrog;
+        case IntegratorType::YOSHIDA4:
+            return yoshida4;
+        case IntegratorType::EULER:
+        default:
+            return euler;
+    }
+}
@@ -1,9 +1,17 @@
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include <glad/glad.h>
+#ifdef HAVE_GLFW
 #include <GLFW/glfw3.h>
+#endif
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -11,12 +19,23 @@
 #include <shader.h>
 #include <compute_shader.h>
 #include <camera.h>
+#include <fixed_timestep.h>
+#include <particle_renderer.h>
+#include <profiler.h>
+#include <simulation_thread.h>
+#include <trace.h>
+#ifdef HAVE_EGL
+#include <headless_context.h>
+#include <framebuffer.h>
+#endif
 
 #include "particle_system.h"
 
 
+#ifdef HAVE_GLFW
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
+#endif
 
 // settings
 const unsigned int SCR_WIDTH = 1920;
@@ -39,6 +58,195 @@ float lastMouseY = 300.0f;
 bool firstMouse = true;
 float mixin = 0.0f;
 
+// command line options
+struct Options {
+    // render into an offscreen framebuffer through EGL instead of opening a window
+    bool headless = false;
+    // number of frames to run in headless mode
+    int frames = 600;
+    // headless mode writes every dumpEvery-th frame into dumpDirectory as frame_NNNNN.ppm
+    std::string dumpDirectory;
+    int dumpEvery = 0;
+    // run the simulation on its own thread (always on the CPU backend) and only draw here
+    bool threaded = false;
+    // the simulation advances in fixed steps of stepSize regardless of frame rate, at most
+    // maxSubsteps of them per frame
+    float stepSize = 1.0f / 60.0f;
+    int maxSubsteps = 4;
+    // print per-pass CPU/GPU timings once a second, and/or write the final ones to profilePath
+    bool profile = false;
+    std::string profilePath;
+    // record a Chrome trace (chrome://tracing, ui.perfetto.dev) of frames, passes and counters
+    std::string tracePath;
+    // simulation setup, including restart/checkpoint snapshot paths
+    ParticleSystemSettings settings;
+};
+
+Options parseArguments(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "missing value for " << argv[i] << std::endl;
+                std::exit(-1);
+            }
+            return argv[++i];
+        };
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+        } else if (std::strcmp(argv[i], "--frames") == 0) {
+            options.frames = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--dump-dir") == 0) {
+            options.dumpDirectory = value();
+            if (options.dumpEvery == 0) options.dumpEvery = 1;
+        } else if (std::strcmp(argv[i], "--dump-every") == 0) {
+            options.dumpEvery = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--particles") == 0) {
+            options.settings.numParticles = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--restart") == 0) {
+            options.settings.restartPath = value();
+        } else if (std::strcmp(argv[i], "--checkpoint") == 0) {
+            options.settings.checkpointPath = value();
+            if (options.settings.checkpointInterval == 0) options.settings.checkpointInterval = 600;
+        } else if (std::strcmp(argv[i], "--checkpoint-every") == 0) {
+            options.settings.checkpointInterval = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--sort-every") == 0) {
+            options.settings.sortInterval = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--dt") == 0) {
+            options.stepSize = std::stof(value());
+        } else if (std::strcmp(argv[i], "--max-substeps") == 0) {
+            options.maxSubsteps = std::stoi(value());
+        } else if (std::strcmp(argv[i], "--threaded") == 0) {
+            options.threaded = true;
+        } else if (std::strcmp(argv[i], "--profile") == 0) {
+            options.profile = true;
+        } else if (std::strcmp(argv[i], "--profile-csv") == 0) {
+            options.profilePath = value();
+        } else if (std::strcmp(argv[i], "--trace") == 0) {
+            options.tracePath = value();
+        } else if (std::strcmp(argv[i], "--kernel") == 0) {
+            const char* kernel = value();
+            if (std::strcmp(kernel, "tiled") == 0) {
+                options.settings.directSumKernel = GpuKernel::TILED;
+            } else if (std::strcmp(kernel, "direct") == 0) {
+                options.settings.directSumKernel = GpuKernel::DIRECT_SUM;
+            } else {
+                std::cerr << "unknown kernel " << kernel << ", expected direct or tiled" << std::endl;
+                std::exit(-1);
+            }
+        } else if (std::strcmp(argv[i], "--tree") == 0) {
+            options.settings.solver = ForceSolverType::BARNES_HUT;
+        } else if (std::strcmp(argv[i], "--theta") == 0) {
+            options.settings.theta = std::stof(value());
+        } else {
+            std::cerr << "unknown argument " << argv[i] << "\n"
+                      << "usage: " << argv[0] << " [--headless [--frames N] [--dump-dir DIR] [--dump-every N]] [--particles N]\n"
+                      << "       [--restart FILE] [--checkpoint FILE] [--checkpoint-every STEPS]\n"
+                      << "       [--sort-every STEPS] [--kernel direct|tiled] [--tree [--theta THETA]] [--threaded]\n"
+                      << "       [--dt SECONDS] [--max-substeps N]\n"
+                      << "       [--profile] [--profile-csv FILE] [--trace FILE]" << std::endl;
+            std::exit(-1);
+        }
+    }
+    if (!(options.stepSize > 0.0f) || options.maxSubsteps < 1) {
+        std::cerr << "--dt has to be positive and --max-substeps at least 1" << std::endl;
+        std::exit(-1);
+    }
+    return options;
+}
+
+// orbits the camera one frame's worth around the origin
+void orbitCamera(glm::mat4& view, glm::mat4& projection) {
+    // create transformations
+    glm::vec3 cameraPos(2.0f * cos(camera.yaw), 0.0f, 2.0f * sin(camera.yaw));
+    camera.position = cameraPos;
+    camera.forward = -glm::normalize(cameraPos);
+    camera.right = glm::normalize(glm::cross(camera.forward, camera.worldUp));
+    camera.up = glm::cross(camera.right, camera.forward);
+    view = camera.getViewTransform();
+
+    projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+
+    camera.yaw += .015f;
+
+    // the camera stays in the xz plane
+    traceCounter("camera x", camera.position.x);
+    traceCounter("camera z", camera.position.z);
+}
+
+// shared by the windowed and headless loops: orbit the camera, advance the simulation and draw
+void drawFrame(ParticleSystem& particleSystem, FixedTimestep& timestep, float frameTime) {
+    // render
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glm::mat4 view, projection;
+    orbitCamera(view, projection);
+
+    int steps = timestep.advance(frameTime);
+    for (int step = 0; step < steps; step++) {
+        particleSystem.update(timestep.getStepSize());
+    }
+    particleSystem.render(view, projection, timestep.getInterpolationAlpha());
+}
+
+// the --threaded counterpart: draws whatever the simulation thread published last, blending in
+// its last step over one step length after it was published (so the picture runs a step behind)
+void drawThreadedFrame(SimulationThread& simulation, ParticleRenderer& renderer) {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glm::mat4 view, projection;
+    orbitCamera(view, projection);
+
+    if (simulation.acquireFrame()) {
+        renderer.upload(simulation.frame());
+    }
+    float sincePublish = std::chrono::duration<float>(std::chrono::steady_clock::now() - simulation.frame().publishTime).count();
+    renderer.render(view, projection, std::min(1.0f, sincePublish / simulation.getStepSize()));
+}
+
+// prints the frame rate and the simulation step rate about once a second, followed by the
+// profiler's pass table when there is one
+class RateReport {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int frames = 0;
+    uint64_t startSteps = 0;
+    const Profiler* profiler;
+
+public:
+    explicit RateReport(const Profiler* profiler = nullptr) : profiler(profiler) {}
+
+    void frame(uint64_t stepCount) {
+        frames++;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds < 1.0) return;
+        std::cout << "render: " << frames / seconds << " fps, simulation: "
+                  << (stepCount - startSteps) / seconds << " steps/s" << std::endl;
+        if (profiler != nullptr) profiler->print(std::cout);
+        start = std::chrono::steady_clock::now();
+        frames = 0;
+        startSteps = stepCount;
+    }
+};
+
+// null unless --profile or --profile-csv asked for one; hooked into the particle system if there is one
+std::unique_ptr<Profiler> makeProfiler(const Options& options, ParticleSystem* particleSystem) {
+    if (!options.profile && options.profilePath.empty()) return nullptr;
+    auto profiler = std::make_unique<Profiler>();
+    if (particleSystem != nullptr) particleSystem->setProfiler(profiler.get());
+    return profiler;
+}
+
+// writes the CSV if asked for and unhooks the profiler, which has to go before the GL context does
+void finishProfiler(const Options& options, std::unique_ptr<Profiler>& profiler, ParticleSystem* particleSystem) {
+    if (!profiler) return;
+    if (!options.profilePath.empty()) profiler->writeCsv(options.profilePath);
+    if (particleSystem != nullptr) particleSystem->setProfiler(nullptr);
+    profiler.reset();
+}
+
+#ifdef HAVE_GLFW
 // process mouse movement
 void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
     if (firstMouse) {
@@ -90,22 +298,32 @@ GLFWwindow* initializeGlfwWindow() {
     return window;
 }
 
-std::ostream& operator<<(std::ostream& os, const glm::vec3& vec) {
-    return os << '(' << vec.x << ", " << vec.y << ", " << vec.z << ')';
-}
-
-int main() {
+int runWindowed(const Options& options) {
     GLFWwindow *window = initializeGlfwWindow();
 
     // build and compile our shader program
     Shader pipelineShaders("../shaders/vertex.glsl", "../shaders/fragment.glsl");
-    ComputeShader computeShader("../shaders/compute.glsl");
-    ParticleSystem particleSystem(&pipelineShaders, &computeShader);
+    // either simulated in this loop or on a SimulationThread and only drawn here
+    std::unique_ptr<ComputeShader> computeShader;
+    std::unique_ptr<ParticleSystem> particleSystem;
+    std::unique_ptr<SimulationThread> simulation;
+    std::unique_ptr<ParticleRenderer> renderer;
+    if (options.threaded) {
+        simulation = std::make_unique<SimulationThread>(options.settings, options.stepSize, options.maxSubsteps);
+        renderer = std::make_unique<ParticleRenderer>(&pipelineShaders);
+    } else {
+        computeShader = std::make_unique<ComputeShader>(gpuKernelPath(gpuKernelFor(options.settings)));
+        particleSystem = std::make_unique<ParticleSystem>(&pipelineShaders, computeShader.get(), options.settings);
+    }
 
     // activate depth buffer culling
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_PROGRAM_POINT_SIZE);
 
+    FixedTimestep timestep(options.stepSize, options.maxSubsteps);
+    std::unique_ptr<Profiler> profiler = makeProfiler(options, particleSystem.get());
+    RateReport rates(options.profile ? profiler.get() : nullptr);
+
     // render loop
     float currentFrame;
     while (!glfwWindowShouldClose(window)) {
@@ -115,38 +333,125 @@ int main() {
         // input
         processInput(window);
 
-        // render
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // create transformations
-        glm::vec3 cameraPos(2.0f * cos(camera.yaw), 0.0f, 2.0f * sin(camera.yaw));
-        camera.position = cameraPos;
-        camera.forward = -glm::normalize(cameraPos);
-        camera.right = glm::normalize(glm::cross(camera.forward, camera.worldUp));
-        camera.up = glm::cross(camera.right, camera.forward);
-        glm::mat4 view = camera.getViewTransform();
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-        camera.yaw += .015f;
-
-        std::cout << "camera forward: " << camera.forward << '\n';
-        std::cout << "camera position: " << camera.position << '\n';
-
-        particleSystem.update(deltaTime);
-        particleSystem.render(view, projection);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        glfwSwapBuffers(window);
+        if (profiler) profiler->beginFrame();
+        {
+            ProfileScope frameScope(profiler.get(), "frame");
+            if (simulation) {
+                ProfileScope renderScope(profiler.get(), "render");
+                drawThreadedFrame(*simulation, *renderer);
+            } else {
+                drawFrame(*particleSystem, timestep, deltaTime);
+            }
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            ProfileScope swapScope(profiler.get(), "swap");
+            glfwSwapBuffers(window);
+        }
+        rates.frame(simulation ? simulation->getStepCount() : particleSystem->getStepCount());
         glfwPollEvents();
     }
 
+    // the GL objects have to go before the context does
+    finishProfiler(options, profiler, particleSystem.get());
+    renderer.reset();
+    particleSystem.reset();
+    computeShader.reset();
     // glfw: terminate, clearing all previously allocated GLFW resources.
     glfwTerminate();
     return 0;
 }
+#endif
+
+#ifdef HAVE_EGL
+// every frame advances the simulation by exactly one step, so headless runs are reproducible;
+// with --threaded the simulation runs in real time instead and frames are drawn as fast as possible
+int runHeadless(const Options& options) {
+    try {
+        HeadlessContext context;
+        OffscreenFramebuffer framebuffer(SCR_WIDTH, SCR_HEIGHT);
+
+        Shader pipelineShaders("../shaders/vertex.glsl", "../shaders/fragment.glsl");
+        std::unique_ptr<ComputeShader> computeShader;
+        std::unique_ptr<ParticleSystem> particleSystem;
+        std::unique_ptr<SimulationThread> simulation;
+        std::unique_ptr<ParticleRenderer> renderer;
+        if (options.threaded) {
+            simulation = std::make_unique<SimulationThread>(options.settings, options.stepSize, options.maxSubsteps);
+            renderer = std::make_unique<ParticleRenderer>(&pipelineShaders);
+        } else {
+            computeShader = std::make_unique<ComputeShader>(gpuKernelPath(gpuKernelFor(options.settings)));
+            particleSystem = std::make_unique<ParticleSystem>(&pipelineShaders, computeShader.get(), options.settings);
+        }
+
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_PROGRAM_POINT_SIZE);
+
+        FixedTimestep timestep(options.stepSize, options.maxSubsteps);
+        std::unique_ptr<Profiler> profiler = makeProfiler(options, particleSystem.get());
+        RateReport rates(options.profile ? profiler.get() : nullptr);
+        for (int frame = 0; frame < options.frames; frame++) {
+            if (profiler) profiler->beginFrame();
+            {
+                ProfileScope frameScope(profiler.get(), "frame");
+                framebuffer.bind();
+                if (simulation) {
+                    ProfileScope renderScope(profiler.get(), "render");
+                    drawThreadedFrame(*simulation, *renderer);
+                } else {
+                    drawFrame(*particleSystem, timestep, options.stepSize);
+                }
+            }
+            rates.frame(simulation ? simulation->getStepCount() : particleSystem->getStepCount());
+
+            if (!options.dumpDirectory.empty() && options.dumpEvery > 0 && frame % options.dumpEvery == 0) {
+                std::string name = std::to_string(frame);
+                name.insert(0, name.size() < 5 ? 5 - name.size() : 0, '0');
+                framebuffer.writePpm(options.dumpDirectory + "/frame_" + name + ".ppm");
+            }
+        }
+        glFinish();
+        finishProfiler(options, profiler, particleSystem.get());
+    } catch (std::runtime_error& e) {
+        std::cout << "Headless run failed: " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+#endif
 
+int main(int argc, char** argv) {
+    Options options = parseArguments(argc, argv);
+
+    // lives until both loops (and the simulation thread) are done
+    std::unique_ptr<TraceRecorder> trace;
+    if (!options.tracePath.empty()) {
+        try {
+            trace = std::make_unique<TraceRecorder>(options.tracePath);
+        } catch (std::runtime_error& e) {
+            std::cout << e.what() << std::endl;
+            return -1;
+        }
+        traceThreadName("main");
+    }
+
+    if (options.headless) {
+#ifdef HAVE_EGL
+        return runHeadless(options);
+#else
+        std::cout << "This build has no headless (EGL) support" << std::endl;
+        return -1;
+#endif
+    }
+
+#ifdef HAVE_GLFW
+    return runWindowed(options);
+#else
+    std::cout << "This build has no window (GLFW) support, run with --headless" << std::endl;
+    return -1;
+#endif
+}
+
+#ifdef HAVE_GLFW
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -176,3 +481,4 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
+#endif
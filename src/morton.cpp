@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cmath>
+#include <morton.h>
+#include <parallel.h>
+
+// spreads the low 21 bits of value so there are two zero bits between each of them
+static uint64_t spreadBits(uint64_t value) {
+    value &= 0x1fffff;
+    value = (value | value << 32) & 0x1f00000000ffffull;
+    value = (value | value << 16) & 0x1f0000ff0000ffull;
+    value = (value | value << 8) & 0x100f00f00f00f00full;
+    value = (value | value << 4) & 0x10c30c30c30c30c3ull;
+    value = (value | value << 2) & 0x1249249249249249ull;
+    return value;
+}
+
+void computeMortonKeys(const std::vector<glm::vec4>& positions, std::vector<uint64_t>& keys) {
+    glm::vec3 lower(INFINITY), upper(-INFINITY);
+    for (const glm::vec4& p : positions) {
+        lower = glm::min(lower, glm::vec3(p));
+        upper = glm::max(upper, glm::vec3(p));
+    }
+    float extent = std::max(1e-6f, std::max(upper.x - lower.x, std::max(upper.y - lower.y, upper.z - lower.z)));
+    // one cube for all axes keeps the curve's cells cubic
+    float scale = (float)((1 << 21) - 1) / extent;
+
+    keys.resize(positions.size());
+    parallelFor(0, positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            glm::uvec3 cell((glm::vec3(positions[i]) - lower) * scale);
+            keys[i] = spreadBits(cell.x) | spreadBits(cell.y) << 1 | spreadBits(cell.z) << 2;
+        }
+    }, 4096);
+}
+
+// each pass: per-worker digit histograms over contiguous chunks, a prefix sum ordered by
+// (digit, worker), then every worker scatters its chunk in order, which keeps the sort stable
+void radixSortByKey(std::vector<uint64_t>& keys, std::vector<uint32_t>& order) {
+    size_t count = keys.size();
+    order.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (uint32_t)i;
+    }
+
+    size_t workers = std::max<size_t>(1, std::min<size_t>(workerCount(), count / 4096));
+    size_t chunkSize = (count + workers - 1) / std::max<size_t>(1, workers);
+    std::vector<uint64_t> keyScratch(count);
+    std::vector<uint32_t> orderScratch(count);
+    std::vector<size_t> histograms(workers * 256);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        std::fill(histograms.begin(), histograms.end(), 0);
+        parallelFor(0, workers, [&](size_t begin, size_t end) {
+            for (size_t worker = begin; worker < end; worker++) {
+                size_t* histogram = &histograms[worker * 256];
+                size_t last = std::min(count, (worker + 1) * chunkSize);
+                for (size_t i = worker * chunkSize; i < last; i++) {
+                    histogram[(keys[i] >> shift) & 0xff]++;
+                }
+            }
+        }, 1);
+
+        size_t offset = 0;
+        bool trivial = false;
+        for (size_t digit = 0; digit < 256; digit++) {
+            size_t digitTotal = 0;
+            for (size_t worker = 0; worker < workers; worker++) {
+                size_t bucket = histograms[worker * 256 + digit];
+                histograms[worker * 256 + digit] = offset;
+                offset += bucket;
+                digitTotal += bucket;
+            }
+            trivial = trivial || digitTotal == count;
+        }
+        if (trivial) continue;
+
+        parallelFor(0, workers, [&](size_t begin, size_t end) {
+            for (size_t worker = begin; worker < end; worker++) {
+                size_t* cursor = &histograms[worker * 256];
+                size_t last = std::min(count, (worker + 1) * chunkSize);
+                for (size_t i = worker * chunkSize; i < last; i++) {
+                    size_t slot = cursor[(keys[i] >> shift) & 0xff]++;
+                    keyScratch[slot] = keys[i];
+                    orderScratch[slot] = order[i];
+                }
+            }
+        }, 1);
+        keys.swap(keyScratch);
+        order.swap(orderScratch);
+    }
+}
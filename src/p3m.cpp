@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cmath>
+#include <p3m.h>
+#include <parallel.h>
+#include <physics.h>
+
+// r_s in mesh cells: wide enough that the mesh resolves the long-range part
+static const float SPLIT_CELLS = 1.25f;
+// cutoff and potential table range in units of r_s
+static const float CUTOFF_SCALES = 6.0f;
+static const float POTENTIAL_SCALES = 10.0f;
+static const int TABLE_SIZE = 4096;
+
+static double shortRangeWindow(double r, double splitScale) {
+    double x = r / (2.0 * splitScale);
+    return std::erfc(x) + 2.0 * x / std::sqrt(M_PI) * std::exp(-x * x);
+}
+
+P3MSolver::P3MSolver(int meshSize) : ParticleMeshSolver(meshSize) {}
+
+// the long-range potential is -integral from r to infinity of G (1 - S) / (r^2 + softening), which
+// has no closed form, so it is integrated down from potentialRange (where S has vanished and the
+// plain softened potential takes over) with the trapezoid rule
+void P3MSolver::computeGreensFunction() {
+    splitScale = SPLIT_CELLS * cellSize;
+    cutoff = CUTOFF_SCALES * splitScale;
+    potentialRange = POTENTIAL_SCALES * splitScale;
+
+    windowTable.resize(TABLE_SIZE + 1);
+    for (int k = 0; k <= TABLE_SIZE; k++) {
+        windowTable[k] = (float)shortRangeWindow(std::sqrt((double)k / TABLE_SIZE) * cutoff, splitScale);
+    }
+
+    auto longRangeForce = [&](double r) {
+        return PhysicsConstants::G * (1.0 - shortRangeWindow(r, splitScale)) / (r * r + PhysicsConstants::SOFTENING);
+    };
+    double dr = (double)potentialRange / TABLE_SIZE;
+    potentialTable.resize(TABLE_SIZE + 1);
+    double phi = ParticleMeshSolver::meshPotential(potentialRange);
+    potentialTable[TABLE_SIZE] = (float)phi;
+    for (int k = TABLE_SIZE - 1; k >= 0; k--) {
+        phi -= 0.5 * (longRangeForce(k * dr) + longRangeForce((k + 1) * dr)) * dr;
+        potentialTable[k] = (float)phi;
+    }
+
+    ParticleMeshSolver::computeGreensFunction();
+}
+
+float P3MSolver::meshPotential(float r) const {
+    if (r >= potentialRange) {
+        return ParticleMeshSolver::meshPotential(r);
+    }
+    float u = r / potentialRange * TABLE_SIZE;
+    int k = std::min((int)u, TABLE_SIZE - 1);
+    float t = u - (float)k;
+    return potentialTable[k] * (1.0f - t) + potentialTable[k + 1] * t;
+}
+
+// counting sort of the particles into cells; the sorted copy keeps each cell's positions contiguous
+void P3MSolver::buildCellList(const std::vector<glm::vec4>& positions) {
+    glm::vec3 lower(INFINITY), upper(-INFINITY);
+    for (const glm::vec4& p : positions) {
+        lower = glm::min(lower, glm::vec3(p));
+        upper = glm::max(upper, glm::vec3(p));
+    }
+    if (positions.empty()) {
+        lower = upper = glm::vec3(0.0f);
+    }
+
+    // a sparse spread-out system would otherwise allocate far more cells than particles
+    glm::vec3 extent = glm::max(upper - lower, glm::vec3(1e-6f));
+    cellWidth = cutoff;
+    size_t cellLimit = 2 * positions.size() + 64;
+    while (true) {
+        cellsX = std::max(1, (int)std::ceil(extent.x / cellWidth));
+        cellsY = std::max(1, (int)std::ceil(extent.y / cellWidth));
+        cellsZ = std::max(1, (int)std::ceil(extent.z / cellWidth));
+        if ((size_t)cellsX * cellsY * cellsZ <= cellLimit) break;
+        cellWidth *= 1.26f;
+    }
+    cellOrigin = lower;
+
+    size_t cellCount = (size_t)cellsX * cellsY * cellsZ;
+    std::vector<uint32_t> cellOf(positions.size());
+    cellStart.assign(cellCount + 1, 0);
+    for (size_t i = 0; i < positions.size(); i++) {
+        glm::ivec3 cell = glm::clamp(glm::ivec3((glm::vec3(positions[i]) - cellOrigin) / cellWidth),
+                                     glm::ivec3(0), glm::ivec3(cellsX - 1, cellsY - 1, cellsZ - 1));
+        cellOf[i] = (uint32_t)(((size_t)cell.z * cellsY + cell.y) * cellsX + cell.x);
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (size_t c = 0; c < cellCount; c++) {
+        cellStart[c + 1] += cellStart[c];
+    }
+
+    sortedIndices.resize(positions.size());
+    sortedPositions.resize(positions.size());
+    std::vector<uint32_t> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < positions.size(); i++) {
+        uint32_t slot = cursor[cellOf[i]]++;
+        sortedIndices[slot] = (uint32_t)i;
+        sortedPositions[slot] = positions[i];
+    }
+}
+
+glm::vec3 P3MSolver::shortRangeAcceleration(const glm::vec4& position, uint32_t index) const {
+    glm::ivec3 cell = glm::clamp(glm::ivec3((glm::vec3(position) - cellOrigin) / cellWidth),
+                                 glm::ivec3(0), glm::ivec3(cellsX - 1, cellsY - 1, cellsZ - 1));
+    glm::vec3 pos(position);
+    float cutoffSqr = cutoff * cutoff;
+    float tableScale = (float)TABLE_SIZE / cutoffSqr;
+    glm::vec3 acc(0.0f);
+
+    int xBegin = std::max(cell.x - 1, 0), xEnd = std::min(cell.x + 1, cellsX - 1);
+    for (int z = std::max(cell.z - 1, 0); z <= std::min(cell.z + 1, cellsZ - 1); z++) {
+        for (int y = std::max(cell.y - 1, 0); y <= std::min(cell.y + 1, cellsY - 1); y++) {
+            // the three cells along x are adjacent in the sorted order
+            size_t row = ((size_t)z * cellsY + y) * cellsX;
+            for (uint32_t j = cellStart[row + xBegin]; j < cellStart[row + xEnd + 1]; j++) {
+                const glm::vec4& other = sortedPositions[j];
+                glm::vec3 dir = glm::vec3(other) - pos;
+                float distSqr = glm::dot(dir, dir);
+                if (distSqr >= cutoffSqr || sortedIndices[j] == index || distSqr == 0.0f) continue;
+
+                float u = distSqr * tableScale;
+                int k = std::min((int)u, TABLE_SIZE - 1);
+                float t = u - (float)k;
+                float window = windowTable[k] * (1.0f - t) + windowTable[k + 1] * t;
+                acc += dir * (other.w * window / (std::sqrt(distSqr) * (distSqr + PhysicsConstants::SOFTENING)));
+            }
+        }
+    }
+    return acc * PhysicsConstants::G;
+}
+
+void P3MSolver::computeAccelerations(const std::vector<glm::vec4>& positions,
+                                     std::vector<glm::vec3>& accelerations) {
+    ParticleMeshSolver::computeAccelerations(positions, accelerations);
+    buildCellList(positions);
+
+    // walking the sorted order keeps neighbouring targets on the same cells
+    parallelFor(0, sortedIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            uint32_t i = sortedIndices[k];
+            accelerations[i] += shortRangeAcceleration(sortedPositions[k], i);
+        }
+    }, 256);
+}
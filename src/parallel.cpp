@@ -0,0 +1,13 @@
+#include <algorithm>
+#include <thread>
+#include <parallel.h>
+#include <task_scheduler.h>
+
+unsigned int workerCount() {
+    static const unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+    return count;
+}
+
+void parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t minChunk) {
+    TaskScheduler::instance().parallelFor(begin, end, body, minChunk);
+}
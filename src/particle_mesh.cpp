@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+#include <particle_mesh.h>
+#include <parallel.h>
+#include <physics.h>
+
+static int roundUpToPowerOfTwo(int value) {
+    int power = 2;
+    while (power < value) power <<= 1;
+    return power;
+}
+
+// cloud-in-cell stencil of a point: the lower corner node and the weight of the upper neighbour
+// along each axis
+struct CicStencil {
+    int x, y, z;
+    glm::vec3 fraction;
+
+    CicStencil(const glm::vec4& position, const glm::vec3& origin, float cellSize, int meshSize) {
+        glm::vec3 u = (glm::vec3(position) - origin) / cellSize;
+        glm::vec3 lower = glm::clamp(glm::floor(u), glm::vec3(0.0f), glm::vec3((float)(meshSize - 2)));
+        x = (int)lower.x;
+        y = (int)lower.y;
+        z = (int)lower.z;
+        fraction = glm::clamp(u - lower, glm::vec3(0.0f), glm::vec3(1.0f));
+    }
+
+    float weight(int corner) const {
+        return ((corner & 1) ? fraction.x : 1.0f - fraction.x)
+             * ((corner & 2) ? fraction.y : 1.0f - fraction.y)
+             * ((corner & 4) ? fraction.z : 1.0f - fraction.z);
+    }
+
+    size_t index(int corner, int meshSize) const {
+        return ((size_t)(z + ((corner >> 2) & 1)) * meshSize + (y + ((corner >> 1) & 1))) * meshSize + (x + (corner & 1));
+    }
+};
+
+ParticleMeshSolver::ParticleMeshSolver(int meshSize)
+    : meshSize(roundUpToPowerOfTwo(std::max(4, meshSize))), fft(2 * this->meshSize) {}
+
+// particles are kept inside nodes [2, meshSize - 3] so the CIC stencil and the differences it
+// reads from all stay on the mesh
+void ParticleMeshSolver::fitMesh(const std::vector<glm::vec4>& positions) {
+    glm::vec3 lower(INFINITY), upper(-INFINITY);
+    for (const glm::vec4& p : positions) {
+        lower = glm::min(lower, glm::vec3(p));
+        upper = glm::max(upper, glm::vec3(p));
+    }
+    if (positions.empty()) {
+        lower = upper = glm::vec3(0.0f);
+    }
+
+    float extent = std::max(1e-6f, std::max(upper.x - lower.x, std::max(upper.y - lower.y, upper.z - lower.z)));
+    float usable = (float)(meshSize - 5);
+    if (cellSize == 0.0f || extent > cellSize * usable || extent < 0.5f * cellSize * usable) {
+        cellSize = extent * 1.1f / usable;
+        computeGreensFunction();
+    }
+    origin = (lower + upper) * 0.5f - glm::vec3(cellSize * (float)(meshSize - 1) * 0.5f);
+}
+
+// the potential whose gradient is the direct sum's softened force G / (r^2 + softening)
+float ParticleMeshSolver::meshPotential(float r) const {
+    float softeningLength = std::sqrt(PhysicsConstants::SOFTENING);
+    return -PhysicsConstants::G * ((float)M_PI_2 - std::atan(r / softeningLength)) / softeningLength;
+}
+
+// sampled at the minimum-image distance on the padded grid so the cyclic convolution of the
+// (zero-padded) density reproduces the isolated sum on the unpadded region
+void ParticleMeshSolver::computeGreensFunction() {
+    size_t n = 2 * meshSize;
+    greensFunction.resize(n * n * n);
+    parallelFor(0, n, [&](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            float dz = (float)std::min(z, n - z) * cellSize;
+            for (size_t y = 0; y < n; y++) {
+                float dy = (float)std::min(y, n - y) * cellSize;
+                for (size_t x = 0; x < n; x++) {
+                    float dx = (float)std::min(x, n - x) * cellSize;
+                    float r = std::sqrt(dx * dx + dy * dy + dz * dz);
+                    greensFunction[(z * n + y) * n + x] = std::complex<float>(meshPotential(r), 0.0f);
+                }
+            }
+        }
+    }, 1);
+    fft.forward(greensFunction);
+
+    // CIC assignment and interpolation each smooth with sinc^2 per axis; dividing the Green's
+    // function by both undoes most of the mesh's force softening (the potential has no power left
+    // near the Nyquist frequency, so this does not amplify noise)
+    std::vector<float> window(n);
+    for (size_t i = 0; i < n; i++) {
+        double x = M_PI * (double)std::min(i, n - i) / (double)n;
+        double sinc = i == 0 ? 1.0 : std::sin(x) / x;
+        window[i] = (float)(sinc * sinc);
+    }
+    parallelFor(0, n, [&](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            for (size_t y = 0; y < n; y++) {
+                for (size_t x = 0; x < n; x++) {
+                    float w = window[x] * window[y] * window[z];
+                    greensFunction[(z * n + y) * n + x] /= w * w;
+                }
+            }
+        }
+    }, 1);
+}
+
+void ParticleMeshSolver::depositMass(const std::vector<glm::vec4>& positions) {
+    size_t cells = (size_t)meshSize * meshSize * meshSize;
+    size_t workers = workerCount();
+    partialDensities.resize(workers);
+    size_t chunkSize = (positions.size() + workers - 1) / workers;
+    parallelFor(0, workers, [&](size_t begin, size_t end) {
+        for (size_t worker = begin; worker < end; worker++) {
+            std::vector<float>& density = partialDensities[worker];
+            density.assign(cells, 0.0f);
+            size_t last = std::min(positions.size(), (worker + 1) * chunkSize);
+            for (size_t i = worker * chunkSize; i < last; i++) {
+                CicStencil stencil(positions[i], origin, cellSize, meshSize);
+                for (int corner = 0; corner < 8; corner++) {
+                    density[stencil.index(corner, meshSize)] += positions[i].w * stencil.weight(corner);
+                }
+            }
+        }
+    }, 1);
+
+    size_t n = 2 * meshSize;
+    paddedGrid.assign(n * n * n, std::complex<float>(0.0f, 0.0f));
+    parallelFor(0, meshSize, [&](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            for (size_t y = 0; y < (size_t)meshSize; y++) {
+                for (size_t x = 0; x < (size_t)meshSize; x++) {
+                    size_t cell = (z * meshSize + y) * meshSize + x;
+                    float mass = 0.0f;
+                    for (const std::vector<float>& density : partialDensities) {
+                        mass += density[cell];
+                    }
+                    paddedGrid[(z * n + y) * n + x] = std::complex<float>(mass, 0.0f);
+                }
+            }
+        }
+    }, 1);
+}
+
+void ParticleMeshSolver::solvePotential() {
+    fft.forward(paddedGrid);
+    parallelFor(0, paddedGrid.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const std::complex<float>& a = paddedGrid[i];
+            const std::complex<float>& b = greensFunction[i];
+            paddedGrid[i] = std::complex<float>(a.real() * b.real() - a.imag() * b.imag(),
+                                                a.real() * b.imag() + a.imag() * b.real());
+        }
+    }, 65536);
+    fft.inverse(paddedGrid);
+
+    size_t n = 2 * meshSize;
+    potential.resize((size_t)meshSize * meshSize * meshSize);
+    parallelFor(0, meshSize, [&](size_t begin, size_t end) {
+        for (size_t z = begin; z < end; z++) {
+            for (size_t y = 0; y < (size_t)meshSize; y++) {
+                for (size_t x = 0; x < (size_t)meshSize; x++) {
+                    potential[(z * meshSize + y) * meshSize + x] = paddedGrid[(z * n + y) * n + x].real();
+                }
+            }
+        }
+    }, 1);
+}
+
+// fourth-order central differences, falling back to second order next to the mesh faces (only
+// reached by the margin nodes, which particles never interpolate from at full weight)
+void ParticleMeshSolver::differentiatePotential() {
+    int n = meshSize;
+    meshAccelerations.resize((size_t)n * n * n);
+    auto derivative = [&](size_t center, size_t stride, int coordinate) {
+        const float* phi = potential.data() + center;
+        long s = (long)stride;
+        if (coordinate >= 2 && coordinate < n - 2) {
+            return (8.0f * (phi[s] - phi[-s]) - (phi[2 * s] - phi[-2 * s])) / (12.0f * cellSize);
+        }
+        long lower = coordinate > 0 ? -s : 0, upper = coordinate < n - 1 ? s : 0;
+        return (phi[upper] - phi[lower]) / ((float)((upper - lower) / s) * cellSize);
+    };
+    parallelFor(0, n, [&](size_t begin, size_t end) {
+        for (int z = (int)begin; z < (int)end; z++) {
+            for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                    size_t cell = ((size_t)z * n + y) * n + x;
+                    meshAccelerations[cell] = -glm::vec3(derivative(cell, 1, x),
+                                                         derivative(cell, (size_t)n, y),
+                                                         derivative(cell, (size_t)n * n, z));
+                }
+            }
+        }
+    }, 1);
+}
+
+void ParticleMeshSolver::computeAccelerations(const std::vector<glm::vec4>& positions,
+                                              std::vector<glm::vec3>& accelerations) {
+    fitMesh(positions);
+    depositMass(positions);
+    solvePotential();
+    differentiatePotential();
+
+    accelerations.resize(positions.size());
+    parallelFor(0, positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            CicStencil stencil(positions[i], origin, cellSize, meshSize);
+            glm::vec3 acc(0.0f);
+            for (int corner = 0; corner < 8; corner++) {
+                acc += meshAccelerations[stencil.index(corner, meshSize)] * stencil.weight(corner);
+            }
+            accelerations[i] = acc;
+        }
+    }, 4096);
+}
@@ -0,0 +1,49 @@
+#include <particle_renderer.h>
+
+ParticleRenderer::ParticleRenderer(Shader* pipelineShaders) : pipelineShaders(pipelineShaders) {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &positionBuffer);
+    glGenBuffers(1, &velocityBuffer);
+    glGenBuffers(1, &previousPositionBuffer);
+
+    glBindVertexArray(vao);
+    GLuint buffers[3] = {positionBuffer, velocityBuffer, previousPositionBuffer};
+    for (GLuint location = 0; location < 3; location++) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[location]);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    }
+    glBindVertexArray(0);
+}
+
+ParticleRenderer::~ParticleRenderer() {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &positionBuffer);
+    glDeleteBuffers(1, &velocityBuffer);
+    glDeleteBuffers(1, &previousPositionBuffer);
+}
+
+void ParticleRenderer::upload(const SimulationFrame& frame) {
+    count = frame.positions.size();
+    size_t bytes = count * sizeof(glm::vec4);
+    const std::vector<glm::vec4>* sources[3] = {&frame.positions, &frame.velocities, &frame.previousPositions};
+    GLuint buffers[3] = {positionBuffer, velocityBuffer, previousPositionBuffer};
+    for (int i = 0; i < 3; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        if (count != capacity) {
+            glBufferData(GL_ARRAY_BUFFER, bytes, sources[i]->data(), GL_STREAM_DRAW);
+        } else {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, sources[i]->data());
+        }
+    }
+    capacity = count;
+}
+
+void ParticleRenderer::render(const glm::mat4& view, const glm::mat4& projection, float interpolationAlpha) {
+    pipelineShaders->use();
+    pipelineShaders->setFloat("interpolationAlpha", interpolationAlpha);
+    pipelineShaders->setMat4("view", view);
+    pipelineShaders->setMat4("projection", projection);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)count);
+}
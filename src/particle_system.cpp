@@ -3,15 +3,186 @@
 //
 
 #include <particle_system.h>
+#include <barnes_hut.h>
+#include <direct_sum.h>
+#include <fmm.h>
+#include <morton.h>
+#include <parallel.h>
+#include <p3m.h>
+#include <physics.h>
+#include <snapshot.h>
+#include <task_scheduler.h>
+#include <algorithm>
+#include <chrono>
 #include <random>
 
-ParticleSystem::ParticleSystem(Shader* pipelineShaders, ComputeShader* computeShader) : pipelineShaders(pipelineShaders), computeShader(computeShader) {
+const char* gpuKernelPath(GpuKernel kernel) {
+    switch (kernel) {
+        case GpuKernel::TILED:
+            return "../shaders/compute_tiled.glsl";
+        case GpuKernel::TREE:
+            return "../shaders/compute_tree.glsl";
+        case GpuKernel::HERMITE:
+            return "../shaders/compute_hermite.glsl";
+        case GpuKernel::DIRECT_SUM:
+        default:
+            return "../shaders/compute.glsl";
+    }
+}
+
+GpuKernel gpuKernelFor(const ParticleSystemSettings& settings) {
+    if (settings.integrator == IntegratorType::HERMITE4) return GpuKernel::HERMITE;
+    return settings.solver == ForceSolverType::BARNES_HUT ? GpuKernel::TREE : settings.directSumKernel;
+}
+
+std::unique_ptr<ForceSolver> createForceSolver(const ParticleSystemSettings& settings) {
+    switch (settings.solver) {
+        case ForceSolverType::DIRECT_SUM_SYMMETRIC:
+            return std::make_unique<SymmetricDirectSumSolver>();
+        case ForceSolverType::BARNES_HUT:
+            if (settings.backend == SimulationBackend::CPU) {
+                return std::make_unique<BarnesHutSolver>(settings.theta);
+            }
+            return nullptr;
+        case ForceSolverType::PARTICLE_MESH:
+            return std::make_unique<ParticleMeshSolver>(settings.meshSize);
+        case ForceSolverType::P3M:
+            return std::make_unique<P3MSolver>(settings.meshSize);
+        case ForceSolverType::FMM:
+            return std::make_unique<FmmSolver>(settings.fmmOrder, settings.fmmLeafSize);
+        case ForceSolverType::DIRECT_SUM:
+        default:
+            if (settings.backend == SimulationBackend::CPU) {
+                return std::make_unique<DirectSumSolver>(settings.accumulation);
+            }
+            return nullptr;
+    }
+}
+
+ParticleSystem::ParticleSystem(Shader* pipelineShaders, ComputeShader* computeShader, const ParticleSystemSettings& settings)
+    : pipelineShaders(pipelineShaders), computeShader(computeShader), settings(settings) {
+    // keeps the tick count of one update within 32 bits
+    this->settings.maxTimestepLevel = std::min(this->settings.maxTimestepLevel, 24);
+    forceSolver = createForceSolver(settings);
+    // kept mapped until the buffers below have been filled from it
+    std::unique_ptr<MappedSnapshot> restart;
+    if (!settings.restartPath.empty()) {
+        restart = std::make_unique<MappedSnapshot>(settings.restartPath);
+        loadSnapshot(*restart);
+    } else {
+        generateInitialConditions();
+    }
+
+    if (settings.accumulation != Accumulation::FLOAT) {
+        positionResiduals.assign(particleCount, glm::vec3(0.0f));
+    }
+
+    if (pipelineShaders == nullptr) {
+        return;
+    }
+
+    const glm::vec4* initialPositions = state.positions.data();
+    const glm::vec4* initialVelocities = state.velocities.data();
+    const uint32_t* initialIds = state.ids.data();
+    std::vector<uint32_t> identity;
+    if (restart && !forceSolver) {
+        initialPositions = restart->positions();
+        initialVelocities = restart->velocities();
+        initialIds = restart->ids();
+        if (initialIds == nullptr) {
+            identity.resize(particleCount);
+            for (size_t i = 0; i < particleCount; i++) {
+                identity[i] = (uint32_t)i;
+            }
+            initialIds = identity.data();
+        }
+    }
+
+    glGenBuffers(2, positionBuffers);
+    glGenBuffers(2, velocityBuffers);
+    glGenBuffers(1, &previousPositionBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, previousPositionBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, particleCount * sizeof(glm::vec4), initialPositions, GL_DYNAMIC_COPY);
+
+    glGenVertexArrays(2, vaos);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, particleCount * sizeof(glm::vec4), initialPositions, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocityBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, particleCount * sizeof(glm::vec4), initialVelocities, GL_DYNAMIC_DRAW);
+
+        glBindVertexArray(vaos[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, positionBuffers[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, velocityBuffers[i]);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, previousPositionBuffer);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    }
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &accelerationBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, accelerationBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, particleCount * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &idBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, idBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, particleCount * sizeof(uint32_t), initialIds, GL_DYNAMIC_COPY);
+
+    if (settings.integrator == IntegratorType::HERMITE4) {
+        glGenBuffers(1, &jerkBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, jerkBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, particleCount * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+    }
+
+    GpuKernel kernel = gpuKernelFor(settings);
+    if (!forceSolver && !positionResiduals.empty() && (kernel == GpuKernel::DIRECT_SUM || kernel == GpuKernel::TILED)) {
+        std::vector<glm::vec4> residuals(particleCount, glm::vec4(0.0f));
+        glGenBuffers(1, &residualBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, residualBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, residuals.size() * sizeof(glm::vec4), residuals.data(), GL_DYNAMIC_COPY);
+    }
+
+    if (!forceSolver && settings.readbackInterval > 0) {
+        readback = std::make_unique<AsyncReadback>();
+    }
+
+    if (!forceSolver && settings.solver == ForceSolverType::BARNES_HUT) {
+        gpuTree = std::make_unique<GpuTree>();
+        gpuTree->reserve((uint32_t)particleCount);
+    }
+}
+
+ParticleSystem::~ParticleSystem() {
+    if (pipelineShaders == nullptr) {
+        return;
+    }
+    glDeleteVertexArrays(2, vaos);
+    glDeleteBuffers(2, positionBuffers);
+    glDeleteBuffers(2, velocityBuffers);
+    glDeleteBuffers(1, &previousPositionBuffer);
+    glDeleteBuffers(1, &accelerationBuffer);
+    glDeleteBuffers(1, &idBuffer);
+    glDeleteBuffers(1, &jerkBuffer);
+    glDeleteBuffers(1, &residualBuffer);
+    if (gpuSort) {
+        glDeleteBuffers(1, &sortKeyBuffer);
+        glDeleteBuffers(1, &sortIndexBuffer);
+        glDeleteBuffers(1, &boundsBuffer);
+        glDeleteBuffers(1, &gatherScratchBuffer);
+    }
+}
+
+void ParticleSystem::generateInitialConditions() {
     std::default_random_engine generator(1294);
     std::uniform_real_distribution<float> distribution(-1, 1);
     std::uniform_real_distribution<float> distribution2(-0.3, 0.3);
     std::uniform_real_distribution<float> massDistribution(50000.0f, 100000.0f);
 
-    for (int i = 0; i < NUM_PARTICLES; i++) {
+    for (int i = 0; i < settings.numParticles; i++) {
         glm::vec3 position;
         // am lazy, should realistically generate via polar coordinates
         // for starting points inside unit sphere about origin
@@ -23,52 +194,621 @@ ParticleSystem::ParticleSystem(Shader* pipelineShaders, ComputeShader* computeSh
             );
         } while (glm::length(position) > 1.0f);
 
-        Particle p;
-        p.position = glm::vec4(position, 1.0f);
-        glm::vec3 tangent = glm::normalize(glm::cross(glm::vec3(p.position.x, p.position.y, p.position.z), glm::vec3(0.0f, 0.0f, 1.0f))) * 0.05f;
-        p.velocity = glm::vec4(tangent.x, tangent.y, tangent.z, 0.0f);
-        p.mass = massDistribution(generator);
+        glm::vec3 tangent = glm::normalize(glm::cross(position, glm::vec3(0.0f, 0.0f, 1.0f))) * 0.05f;
+        float mass = massDistribution(generator);
 
-        particles.push_back(p);
+        state.positions.emplace_back(position, mass);
+        state.velocities.emplace_back(tangent, 0.0f);
+        state.ids.push_back((uint32_t)i);
     }
+    particleCount = state.size();
+}
 
-    glGenBuffers(1, &shaderStorageBufferObject);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, shaderStorageBufferObject);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                  particles.size() * sizeof(Particle),
-                  particles.data(),
-                  GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, shaderStorageBufferObject);
+// the snapshot arrays are already in ParticleState layout, so the CPU backend seeds its state with
+// two straight copies out of the mapping
+void ParticleSystem::loadSnapshot(const MappedSnapshot& snapshot) {
+    particleCount = snapshot.particleCount();
+    stepCount = snapshot.step();
+    simulationTime = snapshot.time();
+    this->settings.numParticles = (int)snapshot.particleCount();
+    if (!forceSolver && pipelineShaders != nullptr) {
+        return;
+    }
+    state.positions.assign(snapshot.positions(), snapshot.positions() + snapshot.particleCount());
+    state.velocities.assign(snapshot.velocities(), snapshot.velocities() + snapshot.particleCount());
+    state.ids.resize(snapshot.particleCount());
+    for (size_t i = 0; i < state.ids.size(); i++) {
+        state.ids[i] = snapshot.ids() != nullptr ? snapshot.ids()[i] : (uint32_t)i;
+    }
+}
 
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, shaderStorageBufferObject);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, position));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)offsetof(Particle, velocity));
+bool ParticleSystem::saveSnapshot(const std::string& path) {
+    return writeSnapshot(path, readState(), stepCount, simulationTime);
 }
 
 void ParticleSystem::update(float deltaTime) {
+    ProfileScope updateScope(profiler, "update");
+    {
+        ProfileScope scope(profiler, "advance");
+        advance(deltaTime);
+    }
+    stepCount++;
+    simulationTime += deltaTime;
+    if (settings.sortInterval > 0 && stepCount % settings.sortInterval == 0) {
+        ProfileScope scope(profiler, "sort");
+        sortParticles();
+    }
+    if (settings.checkpointInterval > 0 && stepCount % settings.checkpointInterval == 0) {
+        ProfileScope scope(profiler, "checkpoint");
+        saveSnapshot(settings.checkpointPath);
+    }
+    if (readback && stepCount % settings.readbackInterval == 0) {
+        ProfileScope scope(profiler, "readback");
+        requestReadback();
+    }
+}
+
+void ParticleSystem::requestReadback() {
+    size_t vec4Bytes = particleCount * sizeof(glm::vec4);
+    readback->request({
+        {positionBuffers[currentBuffer], 0, vec4Bytes},
+        {velocityBuffers[currentBuffer], 0, vec4Bytes},
+        {idBuffer, 0, particleCount * sizeof(uint32_t)}
+    }, stepCount);
+}
+
+const ParticleState* ParticleSystem::pollReadback(uint64_t* step) {
+    if (forceSolver) {
+        if (step != nullptr) *step = stepCount;
+        return &state;
+    }
+    if (!readback) return nullptr;
+    uint64_t tag;
+    const unsigned char* data = static_cast<const unsigned char*>(readback->poll(tag));
+    if (data == nullptr) return nullptr;
+    size_t count = particleCount;
+    const glm::vec4* positions = reinterpret_cast<const glm::vec4*>(data);
+    const glm::vec4* velocities = positions + count;
+    const uint32_t* ids = reinterpret_cast<const uint32_t*>(velocities + count);
+    readbackState.positions.assign(positions, positions + count);
+    readbackState.velocities.assign(velocities, velocities + count);
+    readbackState.ids.assign(ids, ids + count);
+    if (step != nullptr) *step = tag;
+    return &readbackState;
+}
+
+void ParticleSystem::sortParticles() {
+    auto start = std::chrono::steady_clock::now();
+    if (!forceSolver) {
+        sortOnGpu();
+    } else {
+        // keys, then the sort, then every array's permutation as its own task; the first two
+        // spread over the workers themselves, the permutations run side by side
+        TaskScheduler& scheduler = TaskScheduler::instance();
+        TaskHandle keyed = scheduler.submit([this]() { computeMortonKeys(state.positions, sortKeys); });
+        TaskHandle sorted = scheduler.submit([this]() { radixSortByKey(sortKeys, sortOrder); }, {keyed});
+        std::vector<TaskHandle> permutations;
+        auto permuteAfterSort = [&](auto& values) {
+            if (values.size() != particleCount) return;
+            permutations.push_back(scheduler.submit([this, &values]() {
+                std::remove_reference_t<decltype(values)> scratch;
+                permute(values, sortOrder, scratch);
+            }, {sorted}));
+        };
+        permuteAfterSort(state.positions);
+        permuteAfterSort(state.velocities);
+        permuteAfterSort(state.ids);
+        permuteAfterSort(previousPositions);
+        permuteAfterSort(accelerations);
+        permuteAfterSort(previousAccelerations);
+        permuteAfterSort(evaluationTimes);
+        permuteAfterSort(previousEvaluationTimes);
+        permuteAfterSort(jerks);
+        permuteAfterSort(hermiteTimesteps);
+        permuteAfterSort(positionResiduals);
+        scheduler.wait(permutations);
+        if (pipelineShaders != nullptr) {
+            gpuBufferStale = true;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sortStats.sorts++;
+    sortStats.lastSeconds = seconds;
+    sortStats.totalSeconds += seconds;
+}
+
+// same keys and order as the CPU sort, without the state ever leaving the GPU: positions and
+// velocities are gathered into the other ping-pong pair, the rest through a scratch buffer. The
+// acceleration buffer is permuted too, so a cached force evaluation stays valid.
+void ParticleSystem::sortOnGpu() {
+    uint32_t count = (uint32_t)particleCount;
+    if (count == 0) return;
+    if (!gpuSort) {
+        gpuSort = std::make_unique<GpuRadixSort>();
+        mortonShader = std::make_unique<ComputeShader>("../shaders/morton_keys.glsl");
+        gatherShader = std::make_unique<ComputeShader>("../shaders/gather.glsl");
+        size_t keyCapacity = 0, indexCapacity = 0, boundsCapacity = 0, scratchCapacity = 0;
+        ensureBufferSize(sortKeyBuffer, keyCapacity, count * 2 * sizeof(uint32_t));
+        ensureBufferSize(sortIndexBuffer, indexCapacity, count * sizeof(uint32_t));
+        ensureBufferSize(boundsBuffer, boundsCapacity, 6 * sizeof(uint32_t));
+        ensureBufferSize(gatherScratchBuffer, scratchCapacity, count * sizeof(glm::vec4));
+    }
+
+    // empty box: lower at the largest encoded float, upper at the smallest
+    const uint32_t emptyBounds[6] = {0xffffffffu, 0xffffffffu, 0xffffffffu, 0u, 0u, 0u};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(emptyBounds), emptyBounds);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffers[currentBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, boundsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, sortKeyBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, sortIndexBuffer);
+    mortonShader->use();
+    mortonShader->setUint("count", count);
+    GLuint groups = (count + 255) / 256;
+    for (int stage = 0; stage < 2; stage++) {
+        mortonShader->setInt("stage", stage);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    gpuSort->sort(sortKeyBuffer, sortIndexBuffer, count, 63);
+
+    int nextBuffer = 1 - currentBuffer;
+    gather(positionBuffers[currentBuffer], positionBuffers[nextBuffer], 4);
+    gather(velocityBuffers[currentBuffer], velocityBuffers[nextBuffer], 4);
+    currentBuffer = nextBuffer;
+    gather(previousPositionBuffer, previousPositionBuffer, 4);
+    gather(accelerationBuffer, accelerationBuffer, 4);
+    if (jerkBuffer != 0) {
+        gather(jerkBuffer, jerkBuffer, 4);
+    }
+    if (residualBuffer != 0) {
+        gather(residualBuffer, residualBuffer, 4);
+    }
+    gather(idBuffer, idBuffer, 1);
+    // waits so the recorded sort time covers the GPU work rather than just its submission
+    glFinish();
+}
+
+// in place when input == output, through gatherScratchBuffer
+void ParticleSystem::gather(GLuint input, GLuint output, uint32_t wordsPerElement) {
+    uint32_t count = (uint32_t)particleCount;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sortIndexBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, input);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, input == output ? gatherScratchBuffer : output);
+    gatherShader->use();
+    gatherShader->setUint("count", count);
+    gatherShader->setUint("wordsPerElement", wordsPerElement);
+    glDispatchCompute((count + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (input == output) {
+        glBindBuffer(GL_COPY_READ_BUFFER, gatherScratchBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, output);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (size_t)count * wordsPerElement * sizeof(uint32_t));
+    }
+}
+
+void ParticleSystem::advance(float deltaTime) {
+    if (forceSolver) {
+        if (pipelineShaders != nullptr) {
+            previousPositions = state.positions;
+        }
+        if (settings.integrator == IntegratorType::HERMITE4) {
+            stepHermite(deltaTime);
+        } else if (settings.maxTimestepLevel > 0) {
+            stepBlocks(deltaTime);
+        } else {
+            stepOnCpu(deltaTime);
+        }
+        gpuBufferStale = true;
+        return;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, positionBuffers[currentBuffer]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, previousPositionBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, particleCount * sizeof(glm::vec4));
+    if (settings.integrator == IntegratorType::HERMITE4) {
+        dispatchHermite(deltaTime);
+        return;
+    }
+    for (const IntegratorStage& stage : integratorStages(settings.integrator)) {
+        bool evaluateForces = stage.kick != 0.0f && !accelerationsCurrent;
+        dispatchStage(stage, deltaTime, evaluateForces);
+        accelerationsCurrent = (accelerationsCurrent || evaluateForces) && stage.drift == 0.0f;
+    }
+}
+
+void ParticleSystem::dispatchStage(const IntegratorStage& stage, float deltaTime, bool evaluateForces) {
+    if (gpuTree) {
+        if (evaluateForces) {
+            ProfileScope scope(profiler, "tree build");
+            gpuTree->build(positionBuffers[currentBuffer], (uint32_t)particleCount);
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, gpuTree->nodes());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, gpuTree->order());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, gpuTree->stackOverflowCounter());
+    }
+
+    int nextBuffer = 1 - currentBuffer;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffers[currentBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velocityBuffers[currentBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, positionBuffers[nextBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, velocityBuffers[nextBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, accelerationBuffer);
+    if (residualBuffer != 0) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, residualBuffer);
+    }
+
     computeShader->use();
     computeShader->setFloat("deltaTime", deltaTime);
-    glDispatchCompute(static_cast<GLuint>(std::ceil(NUM_PARTICLES / 128.0f)), 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    computeShader->setFloat("kickCoefficient", stage.kick);
+    computeShader->setFloat("driftCoefficient", stage.drift);
+    computeShader->setBool("evaluateForces", evaluateForces);
+    // the residuals are only bound for the kernels that read them
+    computeShader->setInt("accumulation", residualBuffer != 0 ? (int)settings.accumulation : 0);
+    if (gpuTree) {
+        computeShader->setFloat("theta", settings.theta);
+    }
+    glDispatchCompute(static_cast<GLuint>(std::ceil(particleCount / 128.0f)), 1, 1);
+
+    // the draw of the previous frame only reads the buffer this dispatch reads too, so the two can
+    // overlap; the barrier only orders this dispatch before whatever consumes its output next
+    // (the next stage, the draw, or a buffer copy/readback)
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    currentBuffer = nextBuffer;
+}
+
+// the prediction goes into the other ping-pong pair and the correction back into the current one,
+// so currentBuffer does not change
+void ParticleSystem::dispatchHermite(float deltaTime) {
+    int nextBuffer = 1 - currentBuffer;
+    GLuint groups = static_cast<GLuint>(std::ceil(particleCount / 128.0f));
+    computeShader->use();
+    computeShader->setFloat("deltaTime", deltaTime);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffers[currentBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, velocityBuffers[currentBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, accelerationBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, jerkBuffer);
+
+    if (!accelerationsCurrent) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, positionBuffers[currentBuffer]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, velocityBuffers[currentBuffer]);
+        computeShader->setInt("stage", 2);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        accelerationsCurrent = true;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, positionBuffers[nextBuffer]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, velocityBuffers[nextBuffer]);
+    for (int stage = 0; stage < 2; stage++) {
+        computeShader->setInt("stage", stage);
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+}
+
+// position += delta, with the fp32 rounding error of the sum (TwoSum) kept in residual and added
+// to the next delta, so position + residual tracks the exact sum of the drifts
+static void compensatedDrift(glm::vec4& position, glm::vec3& residual, const glm::vec3& delta) {
+    glm::vec3 pos(position);
+    glm::vec3 step = delta + residual;
+    glm::vec3 sum = pos + step;
+    glm::vec3 stepPart = sum - pos;
+    residual = (pos - (sum - stepPart)) + (step - stepPart);
+    position = glm::vec4(sum, position.w);
+}
+
+// runs the same stage sequence as the GPU path; the shader used to add the drag force once per
+// interaction, so it is scaled by (N - 1) here to match
+void ParticleSystem::stepOnCpu(float deltaTime) {
+    float dragScale = PhysicsConstants::DRAG * (float)(particleCount - 1);
+    for (const IntegratorStage& stage : integratorStages(settings.integrator)) {
+        bool evaluateForces = stage.kick != 0.0f && !accelerationsCurrent;
+        if (evaluateForces) {
+            forceSolver->computeAccelerations(state.positions, accelerations);
+        }
+
+        float kick = stage.kick * deltaTime;
+        float drift = stage.drift * deltaTime;
+        parallelFor(0, particleCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                glm::vec4& position = state.positions[i];
+                glm::vec3 vel(state.velocities[i]);
+                glm::vec3 acc = accelerations[i] - vel * (dragScale / position.w);
+                vel += acc * kick;
+                state.velocities[i] = glm::vec4(vel, state.velocities[i].w);
+                if (!positionResiduals.empty()) {
+                    compensatedDrift(position, positionResiduals[i], vel * drift);
+                } else {
+                    position = glm::vec4(glm::vec3(position) + vel * drift, position.w);
+                }
+            }
+        }, 4096);
+
+        accelerationsCurrent = (accelerationsCurrent || evaluateForces) && stage.drift == 0.0f;
+    }
+}
+
+// the level whose step deltaTime / 2^level is the largest one not above timestep. A level may
+// only coarsen where the new, longer step starts on a multiple of its own length, so the block
+// steps stay nested. A zero or NaN timestep (no acceleration to scale by, or a particle sitting
+// where every force cancels) asks for the finest level; the clamp happens in double, since log2
+// of it is not finite and casting that to int is undefined.
+int ParticleSystem::blockLevel(double timestep, float deltaTime, uint32_t tick) const {
+    int maxLevel = settings.maxTimestepLevel;
+    int level = maxLevel;
+    if (timestep >= deltaTime) {
+        level = 0;
+    } else if (timestep > 0.0) {
+        level = (int)std::min((double)maxLevel, std::ceil(std::log2(deltaTime / timestep)));
+    }
+    while (level < maxLevel && tick % ((1u << maxLevel) >> level) != 0) {
+        level++;
+    }
+    return level;
+}
+
+// eta * |a| / |da/dt| with the jerk estimated from the particle's last two evaluations; before
+// there are two, sqrt(2 eta softening / |a|) instead
+int ParticleSystem::timestepLevel(size_t i, float deltaTime, uint32_t tick) const {
+    float acceleration = glm::length(accelerations[i]);
+    double timestep = deltaTime;
+    if (previousEvaluationTimes[i] < evaluationTimes[i]) {
+        float jerk = glm::length(accelerations[i] - previousAccelerations[i]) / (float)(evaluationTimes[i] - previousEvaluationTimes[i]);
+        if (jerk > 0.0f) timestep = settings.timestepAccuracy * acceleration / jerk;
+    } else if (acceleration > 0.0f) {
+        timestep = std::sqrt(2.0 * settings.timestepAccuracy * PhysicsConstants::SOFTENING / acceleration);
+    }
+    return blockLevel(timestep, deltaTime, tick);
+}
+
+// hierarchical kick-drift-kick: every particle is synchronised at the start and end of the update,
+// in between each one kicks at the ends of its own step. Drifts are cheap and move everyone, so
+// the sources are always current; force evaluations only happen for the particles whose step ends.
+void ParticleSystem::stepBlocks(float deltaTime) {
+    size_t count = particleCount;
+    uint32_t ticks = 1u << settings.maxTimestepLevel;
+    double tickLength = (double)deltaTime / ticks;
+    float dragScale = PhysicsConstants::DRAG * (float)(count - 1);
+    auto kick = [&](uint32_t i, float dt) {
+        glm::vec3 vel(state.velocities[i]);
+        vel += (accelerations[i] - vel * (dragScale / state.positions[i].w)) * dt;
+        state.velocities[i] = glm::vec4(vel, state.velocities[i].w);
+    };
+
+    if (!accelerationsCurrent) {
+        forceSolver->computeAccelerations(state.positions, accelerations);
+        accelerationsCurrent = true;
+    }
+    if (timestepLevels.size() != count) {
+        timestepLevels.assign(count, 0);
+        previousAccelerations = accelerations;
+        evaluationTimes.assign(count, simulationTime);
+        previousEvaluationTimes.assign(count, simulationTime);
+    }
+
+    // everyone starts a step, and may coarsen by any amount since tick 0 divides everything
+    stepEnds.resize(count);
+    parallelFor(0, count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            timestepLevels[i] = (uint8_t)timestepLevel(i, deltaTime, 0);
+            uint32_t stepTicks = ticks >> timestepLevels[i];
+            kick((uint32_t)i, (float)(0.5 * stepTicks * tickLength));
+            stepEnds[i] = stepTicks;
+        }
+    }, 4096);
+
+    uint32_t tick = 0;
+    while (tick < ticks) {
+        uint32_t next = *std::min_element(stepEnds.begin(), stepEnds.end());
+        float drift = (float)((next - tick) * tickLength);
+        parallelFor(0, count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                glm::vec4& position = state.positions[i];
+                if (!positionResiduals.empty()) {
+                    compensatedDrift(position, positionResiduals[i], glm::vec3(state.velocities[i]) * drift);
+                } else {
+                    position = glm::vec4(glm::vec3(position) + glm::vec3(state.velocities[i]) * drift, position.w);
+                }
+            }
+        }, 4096);
+        tick = next;
+        double time = simulationTime + tick * tickLength;
+
+        activeParticles.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            if (stepEnds[i] == tick) {
+                activeParticles.push_back(i);
+                previousAccelerations[i] = accelerations[i];
+                previousEvaluationTimes[i] = evaluationTimes[i];
+                evaluationTimes[i] = time;
+            }
+        }
+        forceSolver->computeActiveAccelerations(state.positions, activeParticles, accelerations);
+
+        parallelFor(0, activeParticles.size(), [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                uint32_t i = activeParticles[k];
+                kick(i, (float)(0.5 * (ticks >> timestepLevels[i]) * tickLength));
+                if (tick < ticks) {
+                    timestepLevels[i] = (uint8_t)timestepLevel(i, deltaTime, tick);
+                    uint32_t stepTicks = ticks >> timestepLevels[i];
+                    kick(i, (float)(0.5 * stepTicks * tickLength));
+                    stepEnds[i] = tick + stepTicks;
+                }
+            }
+        }, 256);
+
+        blockStepStats.substeps++;
+        blockStepStats.evaluations += activeParticles.size();
+        blockStepStats.particleSubsteps += count;
+    }
+}
+
+// acceleration and jerk for the active particles at the predicted state; drag is part of the
+// acceleration here, so its derivative -k a joins the jerk
+void ParticleSystem::evaluateHermite(const std::vector<uint32_t>& active) {
+    hermite.evaluate(predictedPositions, predictedVelocities, active, accelerations, jerks);
+    float dragScale = PhysicsConstants::DRAG * (float)(particleCount - 1);
+    parallelFor(0, active.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            uint32_t i = active[k];
+            float drag = dragScale / predictedPositions[i].w;
+            accelerations[i] -= glm::vec3(predictedVelocities[i]) * drag;
+            jerks[i] -= accelerations[i] * drag;
+        }
+    }, 4096);
+}
+
+// Hermite on block timesteps, with the same tick bookkeeping as stepBlocks: at every tick where
+// some particles' steps end, everyone is predicted to that time and only those particles are
+// evaluated and corrected. With maxTimestepLevel 0 this is a shared step of deltaTime.
+void ParticleSystem::stepHermite(float deltaTime) {
+    size_t count = particleCount;
+    uint32_t ticks = 1u << settings.maxTimestepLevel;
+    double tickLength = (double)deltaTime / ticks;
+
+    if (!accelerationsCurrent || jerks.size() != count) {
+        predictedPositions = state.positions;
+        predictedVelocities = state.velocities;
+        activeParticles.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            activeParticles[i] = i;
+        }
+        evaluateHermite(activeParticles);
+        // the usual starting step, eta |a| / |jerk|
+        hermiteTimesteps.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            float jerk = glm::length(jerks[i]);
+            hermiteTimesteps[i] = jerk > 0.0f ? settings.timestepAccuracy * glm::length(accelerations[i]) / jerk : INFINITY;
+        }
+        accelerationsCurrent = true;
+    }
+
+    timestepLevels.resize(count);
+    stepEnds.resize(count);
+    particleTicks.assign(count, 0);
+    for (size_t i = 0; i < count; i++) {
+        timestepLevels[i] = (uint8_t)blockLevel(hermiteTimesteps[i], deltaTime, 0);
+        stepEnds[i] = ticks >> timestepLevels[i];
+    }
+    predictedPositions.resize(count);
+    predictedVelocities.resize(count);
+
+    uint32_t tick = 0;
+    while (tick < ticks) {
+        tick = *std::min_element(stepEnds.begin(), stepEnds.end());
+        parallelFor(0, count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                float h = (float)((tick - particleTicks[i]) * tickLength);
+                glm::vec3 acc = accelerations[i], jerk = jerks[i];
+                glm::vec3 vel(state.velocities[i]);
+                predictedPositions[i] = glm::vec4(glm::vec3(state.positions[i]) + h * (vel + h * (acc * 0.5f + h * jerk / 6.0f)), state.positions[i].w);
+                predictedVelocities[i] = glm::vec4(vel + h * (acc + h * jerk * 0.5f), state.velocities[i].w);
+            }
+        }, 4096);
+
+        activeParticles.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            if (stepEnds[i] == tick) activeParticles.push_back(i);
+        }
+        previousAccelerations.resize(count);
+        previousJerks.resize(count);
+        for (uint32_t i : activeParticles) {
+            previousAccelerations[i] = accelerations[i];
+            previousJerks[i] = jerks[i];
+        }
+        evaluateHermite(activeParticles);
+
+        parallelFor(0, activeParticles.size(), [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                uint32_t i = activeParticles[k];
+                float h = (float)((tick - particleTicks[i]) * tickLength);
+                glm::vec3 a0 = previousAccelerations[i], j0 = previousJerks[i];
+                glm::vec3 a1 = accelerations[i], j1 = jerks[i];
+                // snap and crackle at the start of the step from the Hermite interpolant
+                glm::vec3 snap = (-6.0f * (a0 - a1) - h * (4.0f * j0 + 2.0f * j1)) / (h * h);
+                glm::vec3 crackle = (12.0f * (a0 - a1) + 6.0f * h * (j0 + j1)) / (h * h * h);
+                float h2 = h * h;
+                glm::vec3 pos = glm::vec3(predictedPositions[i]) + h2 * h2 * (snap / 24.0f + h * crackle / 120.0f);
+                glm::vec3 vel = glm::vec3(predictedVelocities[i]) + h2 * h * (snap / 6.0f + h * crackle / 24.0f);
+                state.positions[i] = glm::vec4(pos, state.positions[i].w);
+                state.velocities[i] = glm::vec4(vel, state.velocities[i].w);
+                particleTicks[i] = tick;
+
+                hermiteTimesteps[i] = (float)aarsethTimestep(a1, j1, snap + h * crackle, crackle, settings.timestepAccuracy);
+                if (tick < ticks) {
+                    timestepLevels[i] = (uint8_t)blockLevel(hermiteTimesteps[i], deltaTime, tick);
+                    stepEnds[i] = tick + (ticks >> timestepLevels[i]);
+                }
+            }
+        }, 256);
+
+        blockStepStats.substeps++;
+        blockStepStats.evaluations += activeParticles.size();
+        blockStepStats.particleSubsteps += count;
+    }
+}
+
+void ParticleSystem::uploadState() {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionBuffers[currentBuffer]);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), state.positions.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocityBuffers[currentBuffer]);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), state.velocities.data());
+    if (previousPositions.size() == particleCount) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, previousPositionBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), previousPositions.data());
+    }
+    gpuBufferStale = false;
+}
+
+const ParticleState& ParticleSystem::readState() {
+    if (!forceSolver) {
+        state.positions.resize(particleCount);
+        state.velocities.resize(particleCount);
+        state.ids.resize(particleCount);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionBuffers[currentBuffer]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), state.positions.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocityBuffers[currentBuffer]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(glm::vec4), state.velocities.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, idBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, particleCount * sizeof(uint32_t), state.ids.data());
+    }
+    return state;
+}
+
+const std::vector<glm::vec3>& ParticleSystem::readAccelerations() {
+    if (!forceSolver) {
+        std::vector<glm::vec4> stored(particleCount);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, accelerationBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, stored.size() * sizeof(glm::vec4), stored.data());
+        accelerations.assign(stored.begin(), stored.end());
+    }
+    return accelerations;
 }
 
-void ParticleSystem::render(const glm::mat4& view, const glm::mat4& projection) {
+void ParticleSystem::render(const glm::mat4& view, const glm::mat4& projection, float interpolationAlpha) {
+    ProfileScope scope(profiler, "render");
+    if (gpuBufferStale) uploadState();
     pipelineShaders->use();
+    pipelineShaders->setFloat("interpolationAlpha", interpolationAlpha);
     pipelineShaders->setMat4("view", view);
     pipelineShaders->setMat4("projection", projection);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_POINTS, 0, particles.size());
+    glBindVertexArray(vaos[currentBuffer]);
+    glDrawArrays(GL_POINTS, 0, particleCount);
 }
 
-void ParticleSystem::render(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection) {
+void ParticleSystem::render(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float interpolationAlpha) {
+    ProfileScope scope(profiler, "render");
+    if (gpuBufferStale) uploadState();
     pipelineShaders->use();
+    pipelineShaders->setFloat("interpolationAlpha", interpolationAlpha);
     pipelineShaders->setMat4("model", model);
     pipelineShaders->setMat4("view", view);
     pipelineShaders->setMat4("projection", projection);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_POINTS, 0, particles.size());
+    glBindVertexArray(vaos[currentBuffer]);
+    glDrawArrays(GL_POINTS, 0, particleCount);
 }
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <profiler.h>
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::Profiler(bool gpuTiming, size_t frameLatency, size_t window)
+    : gpuTiming(gpuTiming), window(std::max<size_t>(1, window)), frames(std::max<size_t>(2, frameLatency)) {}
+
+Profiler::~Profiler() {
+    if (!gpuTiming) return;
+    for (Frame& frame : frames) {
+        if (!frame.queries.empty()) glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+    }
+}
+
+size_t Profiler::passIndex(const char* name) {
+    size_t parent = openPasses.empty() ? SIZE_MAX : openPasses.back().pass;
+    for (size_t i = 0; i < passes.size(); i++) {
+        if (passes[i].parent == parent && passes[i].name == name) return i;
+    }
+    passes.push_back({name, parent, (int)openPasses.size(), {}, {}});
+    return passes.size() - 1;
+}
+
+GLuint Profiler::nextQuery(Frame& frame) {
+    if (frame.usedQueries == frame.queries.size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+    return frame.queries[frame.usedQueries++];
+}
+
+void Profiler::addSample(std::deque<double>& samples, double milliseconds, size_t window) {
+    samples.push_back(milliseconds);
+    if (samples.size() > window) samples.pop_front();
+}
+
+// timestamps complete in the order they were issued, so the last one covers the whole frame;
+// passes still open when the frame ended have no end query and are skipped
+bool Profiler::collect(Frame& frame) {
+    if (frame.records.empty()) return true;
+    GLuint available = 0;
+    glGetQueryObjectuiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return false;
+    for (const Record& record : frame.records) {
+        if (record.endQuery == 0) continue;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(record.beginQuery, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(record.endQuery, GL_QUERY_RESULT, &end);
+        addSample(passes[record.pass].gpuSamples, (double)(end - begin) * 1e-6, window);
+    }
+    frame.records.clear();
+    return true;
+}
+
+void Profiler::beginFrame() {
+    openPasses.clear();
+    if (!gpuTiming) return;
+    // oldest first, stopping at the first frame still in flight so samples stay in order
+    for (size_t age = frames.size() - 1; age > 0; age--) {
+        if (!collect(frames[(currentFrame + frames.size() - age) % frames.size()])) break;
+    }
+    currentFrame = (currentFrame + 1) % frames.size();
+    Frame& frame = frames[currentFrame];
+    if (!collect(frame)) {
+        droppedFrames++;
+        frame.records.clear();
+    }
+    frame.usedQueries = 0;
+}
+
+void Profiler::beginPass(const char* name) {
+    size_t pass = passIndex(name);
+    size_t record = SIZE_MAX;
+    if (gpuTiming) {
+        Frame& frame = frames[currentFrame];
+        GLuint query = nextQuery(frame);
+        glQueryCounter(query, GL_TIMESTAMP);
+        frame.records.push_back({pass, query, 0});
+        record = frame.records.size() - 1;
+    }
+    openPasses.push_back({pass, nowNanoseconds(), record});
+}
+
+void Profiler::endPass() {
+    if (openPasses.empty()) return;
+    OpenPass open = openPasses.back();
+    openPasses.pop_back();
+    addSample(passes[open.pass].cpuSamples, (nowNanoseconds() - open.cpuStart) * 1e-6, window);
+    if (gpuTiming && open.record != SIZE_MAX) {
+        Frame& frame = frames[currentFrame];
+        GLuint query = nextQuery(frame);
+        glQueryCounter(query, GL_TIMESTAMP);
+        frame.records[open.record].endQuery = query;
+    }
+}
+
+TimingSummary Profiler::summarise(const std::deque<double>& samples) {
+    TimingSummary summary;
+    summary.samples = samples.size();
+    if (samples.empty()) return summary;
+    std::vector<double> sorted(samples.begin(), samples.end());
+    std::sort(sorted.begin(), sorted.end());
+    summary.min = sorted.front();
+    double total = 0.0;
+    for (double sample : sorted) total += sample;
+    summary.avg = total / sorted.size();
+    summary.p99 = sorted[std::min(sorted.size() - 1, (size_t)std::ceil(0.99 * sorted.size()) - 1)];
+    return summary;
+}
+
+std::vector<PassTimings> Profiler::timings() const {
+    std::vector<PassTimings> result;
+    auto addChildren = [&](size_t parent, auto& addChildren) -> void {
+        for (size_t i = 0; i < passes.size(); i++) {
+            if (passes[i].parent != parent) continue;
+            const Pass& pass = passes[i];
+            result.push_back({pass.name, pass.depth, summarise(pass.cpuSamples), summarise(pass.gpuSamples)});
+            addChildren(i, addChildren);
+        }
+    };
+    addChildren(SIZE_MAX, addChildren);
+    return result;
+}
+
+void Profiler::print(std::ostream& out) const {
+    out << std::fixed << std::setprecision(3);
+    out << "pass                      cpu min/avg/p99 ms          gpu min/avg/p99 ms\n";
+    for (const PassTimings& pass : timings()) {
+        std::string name = std::string(2 * pass.depth, ' ') + pass.name;
+        out << std::left << std::setw(26) << name << std::right
+            << std::setw(8) << pass.cpu.min << std::setw(9) << pass.cpu.avg << std::setw(9) << pass.cpu.p99 << "  ";
+        if (pass.gpu.samples > 0) {
+            out << std::setw(8) << pass.gpu.min << std::setw(9) << pass.gpu.avg << std::setw(9) << pass.gpu.p99;
+        } else {
+            out << std::setw(8) << "-";
+        }
+        out << '\n';
+    }
+    if (droppedFrames > 0) out << droppedFrames << " frames of GPU timings dropped\n";
+    out << std::defaultfloat;
+}
+
+bool Profiler::writeCsv(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "ERROR::PROFILER::FILE_NOT_WRITABLE " << path << std::endl;
+        return false;
+    }
+    file << "pass,depth,cpu_samples,cpu_min_ms,cpu_avg_ms,cpu_p99_ms,gpu_samples,gpu_min_ms,gpu_avg_ms,gpu_p99_ms\n";
+    for (const PassTimings& pass : timings()) {
+        file << pass.name << ',' << pass.depth << ','
+             << pass.cpu.samples << ',' << pass.cpu.min << ',' << pass.cpu.avg << ',' << pass.cpu.p99 << ','
+             << pass.gpu.samples << ',' << pass.gpu.min << ',' << pass.gpu.avg << ',' << pass.gpu.p99 << '\n';
+    }
+    return true;
+}
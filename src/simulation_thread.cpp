@@ -0,0 +1,54 @@
+#include <fixed_timestep.h>
+#include <simulation_thread.h>
+#include <trace.h>
+
+SimulationThread::SimulationThread(ParticleSystemSettings settings, float stepSize, int maxSubsteps)
+    : stepSize(stepSize), maxSubsteps(maxSubsteps) {
+    settings.backend = SimulationBackend::CPU;
+    particleSystem = std::make_unique<ParticleSystem>(nullptr, nullptr, settings);
+    publish(particleSystem->readState().positions);
+    thread = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread() {
+    stopping.store(true, std::memory_order_relaxed);
+    thread.join();
+}
+
+void SimulationThread::publish(const std::vector<glm::vec4>& previousPositions) {
+    const ParticleState& state = particleSystem->readState();
+    SimulationFrame& frame = frames.writeBuffer();
+    frame.positions = state.positions;
+    frame.velocities = state.velocities;
+    frame.previousPositions = previousPositions;
+    frame.step = particleSystem->getStepCount();
+    frame.publishTime = std::chrono::steady_clock::now();
+    frames.publish();
+}
+
+// paced by the wall clock like the single-threaded loop, but the steps are due against this
+// thread's own clock; between steps it sleeps until the next one is due
+void SimulationThread::run() {
+    traceThreadName("simulation");
+    FixedTimestep timestep(stepSize, maxSubsteps);
+    std::vector<glm::vec4> previousPositions;
+    auto last = std::chrono::steady_clock::now();
+    while (!stopping.load(std::memory_order_relaxed)) {
+        auto now = std::chrono::steady_clock::now();
+        int steps = timestep.advance(std::chrono::duration<float>(now - last).count());
+        last = now;
+        if (steps == 0) {
+            float remaining = (1.0f - timestep.getInterpolationAlpha()) * stepSize;
+            std::this_thread::sleep_for(std::chrono::duration<float>(remaining));
+            continue;
+        }
+        // publishing every step rather than every batch keeps a slow simulation's picture moving
+        for (int step = 0; step < steps && !stopping.load(std::memory_order_relaxed); step++) {
+            previousPositions = particleSystem->readState().positions;
+            particleSystem->update(stepSize);
+            stepsTaken.fetch_add(1, std::memory_order_relaxed);
+            publish(previousPositions);
+            traceCounter("simulation step", (double)particleSystem->getStepCount());
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <snapshot.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char SNAPSHOT_MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'S', 'N', 'P'};
+static const uint64_t CHUNK_ALIGNMENT = 64;
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+}
+
+bool writeSnapshot(const std::string& path, const ParticleState& state, uint64_t step, double time) {
+    struct Payload {
+        const char* tag;
+        const void* data;
+        uint32_t elementSize;
+    };
+    std::vector<Payload> payloads = {
+        {"POSM", state.positions.data(), sizeof(glm::vec4)},
+        {"VELO", state.velocities.data(), sizeof(glm::vec4)},
+    };
+    if (state.ids.size() == state.size()) {
+        payloads.push_back({"PIDS", state.ids.data(), sizeof(uint32_t)});
+    }
+    const uint32_t chunkCount = (uint32_t)payloads.size();
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.chunkCount = chunkCount;
+    header.particleCount = state.size();
+    header.step = step;
+    header.time = time;
+
+    std::vector<SnapshotChunk> chunks(chunkCount);
+    uint64_t offset = alignUp(sizeof(SnapshotHeader) + chunkCount * sizeof(SnapshotChunk));
+    for (uint32_t i = 0; i < chunkCount; i++) {
+        std::memcpy(chunks[i].tag, payloads[i].tag, 4);
+        chunks[i].elementSize = payloads[i].elementSize;
+        chunks[i].offset = offset;
+        chunks[i].size = state.size() * payloads[i].elementSize;
+        offset = alignUp(offset + chunks[i].size);
+    }
+
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "ERROR::SNAPSHOT::COULD_NOT_OPEN " << temporaryPath << std::endl;
+            return false;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)chunks.data(), chunks.size() * sizeof(SnapshotChunk));
+        static const char zeros[CHUNK_ALIGNMENT] = {};
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            file.write(zeros, (std::streamsize)(chunks[i].offset - (uint64_t)file.tellp()));
+            file.write((const char*)payloads[i].data, (std::streamsize)chunks[i].size);
+        }
+        if (!file) {
+            std::cerr << "ERROR::SNAPSHOT::WRITE_FAILED " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    bool renamed = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        std::cerr << "ERROR::SNAPSHOT::RENAME_FAILED " << temporaryPath << " -> " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+MappedSnapshot::MappedSnapshot(const std::string& path) {
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        fileHandle = nullptr;
+        throw std::runtime_error("could not open snapshot " + path);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(fileHandle, &size);
+    fileSize = (size_t)size.QuadPart;
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle != nullptr) {
+        data = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (data == nullptr) {
+        release();
+        throw std::runtime_error("could not map snapshot " + path);
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("could not open snapshot " + path);
+    }
+    struct stat info{};
+    fstat(fd, &info);
+    fileSize = (size_t)info.st_size;
+    void* mapping = fileSize > 0 ? mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("could not map snapshot " + path);
+    }
+    data = (const uint8_t*)mapping;
+    // the whole file is about to be streamed into the particle buffers
+    madvise(mapping, fileSize, MADV_WILLNEED);
+#endif
+
+    auto fail = [&](const std::string& reason) {
+        release();
+        throw std::runtime_error("invalid snapshot " + path + ": " + reason);
+    };
+    if (fileSize < sizeof(SnapshotHeader)) fail("file too small");
+    header = (const SnapshotHeader*)data;
+    if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) fail("bad magic");
+    if (header->version > SNAPSHOT_VERSION) fail("written by a newer version (" + std::to_string(header->version) + ")");
+    if (sizeof(SnapshotHeader) + (uint64_t)header->chunkCount * sizeof(SnapshotChunk) > fileSize) fail("truncated chunk table");
+
+    // bounding the count by the file size first keeps the array sizes below from wrapping; the
+    // count also has to fit the int ParticleSystemSettings::numParticles
+    if (header->particleCount > fileSize / sizeof(glm::vec4) || header->particleCount > (uint64_t)INT_MAX) {
+        fail("bad particle count " + std::to_string(header->particleCount));
+    }
+
+    const SnapshotChunk* chunks = (const SnapshotChunk*)(data + sizeof(SnapshotHeader));
+    uint64_t arraySize = header->particleCount * sizeof(glm::vec4);
+    auto insideFile = [&](const SnapshotChunk& chunk) {
+        return chunk.offset <= fileSize && chunk.size <= fileSize - chunk.offset;
+    };
+    for (uint32_t i = 0; i < header->chunkCount; i++) {
+        const SnapshotChunk& chunk = chunks[i];
+        bool positions = std::memcmp(chunk.tag, "POSM", 4) == 0;
+        bool velocities = std::memcmp(chunk.tag, "VELO", 4) == 0;
+        if (std::memcmp(chunk.tag, "PIDS", 4) == 0) {
+            if (chunk.size != header->particleCount * sizeof(uint32_t) || !insideFile(chunk) || chunk.offset % alignof(uint32_t) != 0) {
+                fail("bad PIDS chunk");
+            }
+            idData = (const uint32_t*)(data + chunk.offset);
+            continue;
+        }
+        if (!positions && !velocities) continue;
+        if (chunk.size != arraySize || !insideFile(chunk) || chunk.offset % alignof(glm::vec4) != 0) {
+            fail(std::string("bad ") + std::string(chunk.tag, 4) + " chunk");
+        }
+        (positions ? positionData : velocityData) = (const glm::vec4*)(data + chunk.offset);
+    }
+    if (positionData == nullptr || velocityData == nullptr) fail("missing POSM or VELO chunk");
+}
+
+MappedSnapshot::~MappedSnapshot() {
+    release();
+}
+
+void MappedSnapshot::release() {
+#ifdef _WIN32
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mappingHandle != nullptr) CloseHandle(mappingHandle);
+    if (fileHandle != nullptr) CloseHandle(fileHandle);
+    mappingHandle = fileHandle = nullptr;
+#else
+    if (data != nullptr) munmap((void*)data, fileSize);
+#endif
+    data = nullptr;
+}
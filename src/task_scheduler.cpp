@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <chrono>
+#include <parallel.h>
+#include <task_scheduler.h>
+
+struct Task {
+    std::function<void()> work;
+    // unfinished dependencies, plus one that submit() holds until every dependency is registered
+    std::atomic<int> pending{1};
+    std::atomic<bool> done{false};
+    std::mutex mutex;
+    // guarded by mutex, together with finished
+    bool finished = false;
+    std::vector<TaskHandle> dependents;
+};
+
+// the slot of the calling thread; 0 for every thread outside the pool
+static thread_local size_t currentSlot = 0;
+// tasks running on this thread, more than one while a task waits and runs others meanwhile; only
+// the outermost one counts towards the busy time
+static thread_local int runDepth = 0;
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TaskScheduler::TaskScheduler(unsigned int workerCount) : statsStart(nowNanoseconds()) {
+    workerCount = std::max(1u, workerCount);
+    for (unsigned int slot = 0; slot < workerCount; slot++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned int slot = 1; slot < workerCount; slot++) {
+        threads.emplace_back(&TaskScheduler::workerLoop, this, slot);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping.store(true);
+    }
+    wakeup.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+TaskScheduler& TaskScheduler::instance() {
+    static TaskScheduler scheduler(workerCount());
+    return scheduler;
+}
+
+void TaskScheduler::workerLoop(size_t slot) {
+    currentSlot = slot;
+    while (true) {
+        if (runOne()) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeup.wait(lock, [&]() { return stopping.load() || queued.load() > 0; });
+        if (stopping.load()) return;
+    }
+}
+
+void TaskScheduler::push(const TaskHandle& task) {
+    Worker& worker = *workers[currentSlot];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(task);
+    }
+    queued.fetch_add(1);
+    // taking the lock orders this against a worker that just checked queued and is about to sleep
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wakeup.notify_one();
+}
+
+TaskHandle TaskScheduler::pop(size_t slot) {
+    Worker& worker = *workers[slot];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return nullptr;
+    TaskHandle task = worker.tasks.back();
+    worker.tasks.pop_back();
+    queued.fetch_sub(1);
+    return task;
+}
+
+bool TaskScheduler::runOne() {
+    size_t self = currentSlot;
+    if (TaskHandle task = pop(self)) {
+        run(self, task, false);
+        return true;
+    }
+    if (queued.load() == 0) return false;
+    // victims in turn starting after our own slot, so thieves spread over the deques
+    for (size_t offset = 1; offset < workers.size(); offset++) {
+        Worker& victim = *workers[(self + offset) % workers.size()];
+        TaskHandle task;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+        }
+        queued.fetch_sub(1);
+        run(self, task, true);
+        return true;
+    }
+    return false;
+}
+
+void TaskScheduler::run(size_t slot, const TaskHandle& task, bool stolen) {
+    Worker& worker = *workers[slot];
+    int64_t start = nowNanoseconds();
+    runDepth++;
+    task->work();
+    runDepth--;
+    if (runDepth == 0) {
+        worker.busyNanoseconds.fetch_add((uint64_t)(nowNanoseconds() - start), std::memory_order_relaxed);
+    }
+    worker.executed.fetch_add(1, std::memory_order_relaxed);
+    if (stolen) worker.steals.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<TaskHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->finished = true;
+        dependents.swap(task->dependents);
+    }
+    task->done.store(true, std::memory_order_release);
+    for (const TaskHandle& dependent : dependents) {
+        if (dependent->pending.fetch_sub(1) == 1) push(dependent);
+    }
+}
+
+TaskHandle TaskScheduler::submit(std::function<void()> work, const std::vector<TaskHandle>& dependencies) {
+    TaskHandle task = std::make_shared<Task>();
+    task->work = std::move(work);
+    for (const TaskHandle& dependency : dependencies) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (!dependency->finished) {
+            task->pending.fetch_add(1);
+            dependency->dependents.push_back(task);
+        }
+    }
+    if (task->pending.fetch_sub(1) == 1) push(task);
+    return task;
+}
+
+void TaskScheduler::wait(const TaskHandle& task) {
+    while (!task->done.load(std::memory_order_acquire)) {
+        if (!runOne()) std::this_thread::yield();
+    }
+}
+
+void TaskScheduler::wait(const std::vector<TaskHandle>& tasks) {
+    for (const TaskHandle& task : tasks) {
+        wait(task);
+    }
+}
+
+void TaskScheduler::parallelFor(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t grain) {
+    if (end <= begin) return;
+    size_t count = end - begin;
+    grain = std::max<size_t>(1, grain);
+    size_t chunks = std::min<size_t>(4 * workers.size(), std::max<size_t>(1, count / grain));
+    if (chunks <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    size_t chunkSize = (count + chunks - 1) / chunks;
+    std::vector<TaskHandle> tasks;
+    tasks.reserve(chunks);
+    // pushed last-chunk first, so popping our own deque from the back runs them in order while
+    // thieves take the far end
+    for (size_t chunkBegin = begin + (chunks - 1) * chunkSize; ; chunkBegin -= chunkSize) {
+        size_t chunkEnd = std::min(end, chunkBegin + chunkSize);
+        if (chunkBegin < chunkEnd) {
+            tasks.push_back(submit([&body, chunkBegin, chunkEnd]() { body(chunkBegin, chunkEnd); }));
+        }
+        if (chunkBegin == begin) break;
+    }
+    wait(tasks);
+}
+
+std::vector<WorkerStats> TaskScheduler::workerStats() const {
+    double elapsed = (nowNanoseconds() - statsStart.load()) * 1e-9;
+    std::vector<WorkerStats> stats(workers.size());
+    for (size_t slot = 0; slot < workers.size(); slot++) {
+        stats[slot].tasks = workers[slot]->executed.load();
+        stats[slot].steals = workers[slot]->steals.load();
+        stats[slot].busySeconds = workers[slot]->busyNanoseconds.load() * 1e-9;
+        stats[slot].utilization = elapsed > 0.0 ? stats[slot].busySeconds / elapsed : 0.0;
+    }
+    return stats;
+}
+
+void TaskScheduler::resetStats() {
+    for (const std::unique_ptr<Worker>& worker : workers) {
+        worker->executed.store(0);
+        worker->steals.store(0);
+        worker->busyNanoseconds.store(0);
+    }
+    statsStart.store(nowNanoseconds());
+}
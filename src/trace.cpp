@@ -0,0 +1,134 @@
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <trace.h>
+
+std::atomic<TraceRecorder*> TraceRecorder::current{nullptr};
+
+static int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// small per-thread ids read better in the viewer than hashed std::thread::ids
+static uint32_t currentThreadId() {
+    static std::atomic<uint32_t> nextId{1};
+    static thread_local uint32_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+TraceRecorder::TraceRecorder(const std::string& path, size_t capacity) : file(path), startTime(nowNanoseconds()) {
+    if (!file) {
+        throw std::runtime_error("could not open trace " + path);
+    }
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    slots = std::make_unique<Slot[]>(size);
+    for (size_t i = 0; i < size; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask = size - 1;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    drainThread = std::thread(&TraceRecorder::drain, this);
+    current.store(this, std::memory_order_release);
+}
+
+TraceRecorder::~TraceRecorder() {
+    current.store(nullptr, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        stopping = true;
+    }
+    stopSignal.notify_one();
+    drainThread.join();
+
+    file << "\n],\"otherData\":{\"droppedEvents\":" << getDroppedEvents() << "}}\n";
+    if (getDroppedEvents() > 0) {
+        std::cerr << "trace: dropped " << getDroppedEvents() << " events, the ring was full" << std::endl;
+    }
+}
+
+// a slot whose sequence equals the position is free for that position; after writing, the
+// producer bumps it to position + 1 to hand it to the consumer, which hands it back one lap later
+void TraceRecorder::record(const char* name, char phase, double value) {
+    uint64_t position = head.load(std::memory_order_relaxed);
+    while (true) {
+        Slot& slot = slots[position & mask];
+        int64_t lag = (int64_t)(slot.sequence.load(std::memory_order_acquire) - position);
+        if (lag == 0) {
+            if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.event = {name, nowNanoseconds(), value, currentThreadId(), phase};
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return;
+            }
+        } else if (lag < 0) {
+            // still holding an event from one lap ago
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool TraceRecorder::pop(TraceEvent& event) {
+    Slot& slot = slots[tail & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != tail + 1) return false;
+    event = slot.event;
+    slot.sequence.store(tail + mask + 1, std::memory_order_release);
+    tail++;
+    return true;
+}
+
+// wakes every couple of milliseconds; the producers never signal, so emitting stays wait-free
+void TraceRecorder::drain() {
+    TraceEvent event;
+    while (true) {
+        while (pop(event)) {
+            write(event);
+        }
+        std::unique_lock<std::mutex> lock(stopMutex);
+        if (stopping) break;
+        stopSignal.wait_for(lock, std::chrono::milliseconds(2));
+    }
+    // the recorder is no longer active, but a producer may have been mid-record when it stopped
+    while (pop(event)) {
+        write(event);
+    }
+    file.flush();
+}
+
+void TraceRecorder::write(const TraceEvent& event) {
+    auto writeString = [&](const char* text) {
+        file << '"';
+        for (const char* c = text; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') file << '\\';
+            file << *c;
+        }
+        file << '"';
+    };
+
+    if (!firstEvent) file << ",\n";
+    firstEvent = false;
+    file << "{\"name\":";
+    if (event.phase == 'M') {
+        file << "\"thread_name\"";
+    } else {
+        writeString(event.name);
+    }
+    file << ",\"ph\":\"" << event.phase << "\",\"pid\":1,\"tid\":" << event.thread;
+    if (event.phase != 'M') {
+        // microseconds since the recorder started
+        file << ",\"ts\":" << std::fixed << (double)(event.timestamp - startTime) / 1000.0 << std::defaultfloat;
+    }
+    if (event.phase == 'C') {
+        file << ",\"args\":{\"value\":" << event.value << '}';
+    } else if (event.phase == 'M') {
+        file << ",\"args\":{\"name\":";
+        writeString(event.name);
+        file << '}';
+    } else if (event.phase == 'i') {
+        file << ",\"s\":\"t\"";
+    }
+    file << '}';
+}